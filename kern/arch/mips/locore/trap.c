@@ -38,9 +38,11 @@
 #include <current.h>
 #include <vm.h>
 #include <mainbus.h>
+#include <rcu.h>
 #include <syscall.h>
 #include <proc.h>
 #include <proc_syscalls.h>
+#include <thread_syscalls.h>
 #include <kern/wait.h>
 
 
@@ -163,6 +165,9 @@ mips_trap(struct trapframe *tf)
 		old_in = curthread->t_in_interrupt;
 		curthread->t_in_interrupt = 1;
 
+		/* If we were idle, the handler may be an RCU reader. */
+		rcu_idle_exit();
+
 		/*
 		 * The processor has turned interrupts off; if the
 		 * currently recorded interrupt state is interrupts on
@@ -201,6 +206,24 @@ mips_trap(struct trapframe *tf)
 		}
 
 		curthread->t_in_interrupt = old_in;
+
+		/*
+		 * If we interrupted a user thread whose process is
+		 * being torn down by another thread, don't go back;
+		 * exit instead. Likewise, if its affinity no longer
+		 * allows this cpu, move before going back. Both can
+		 * sleep, so bring the stored interrupt state back in
+		 * sync with the processor first, as below, and turn
+		 * interrupts off again afterwards.
+		 */
+		if (!iskern &&
+		    (uthread_exitpending() || !thread_affinity_ok())) {
+			spl = splhigh();
+			splx(spl);
+			uthread_exitcheck();
+			thread_checkaffinity();
+			goto done;
+		}
 		goto done2;
 	}
 
@@ -228,6 +251,13 @@ mips_trap(struct trapframe *tf)
 		      tf->tf_v0, tf->tf_a0, tf->tf_a1, tf->tf_a2, tf->tf_a3);
 
 		syscall(tf);
+
+		/*
+		 * Another thread may have exited the process meanwhile,
+		 * or we may have been told to run somewhere else.
+		 */
+		uthread_exitcheck();
+		thread_checkaffinity();
 		goto done;
 	}
 
@@ -369,6 +399,7 @@ mips_trap(struct trapframe *tf)
  * following places:
  *    - enter_new_process, for use by exec and equivalent.
  *    - enter_forked_process, in syscall.c, for use by fork.
+ *    - enter_new_thread, for use by thread_create.
  */
 void
 mips_usermode(struct trapframe *tf)
@@ -442,3 +473,26 @@ enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 	mips_usermode(&tf);
 }
+
+/*
+ * enter_new_thread: go to user mode in a new thread of the current
+ * process, calling entry(arg) on the stack given. The stack pointer
+ * is rounded down to the 8-byte alignment the mips ABI wants. GP is
+ * the creating thread's global pointer, which user code expects to
+ * find already set up, as crt0 does it only once per process.
+ */
+void
+enter_new_thread(userptr_t arg, vaddr_t stack, vaddr_t entry, vaddr_t gp)
+{
+	struct trapframe tf;
+
+	bzero(&tf, sizeof(tf));
+
+	tf.tf_status = CST_IRQMASK | CST_IEp | CST_KUp;
+	tf.tf_epc = entry;
+	tf.tf_a0 = (vaddr_t)arg;
+	tf.tf_sp = stack & ~(vaddr_t)7;
+	tf.tf_gp = gp;
+
+	mips_usermode(&tf);
+}
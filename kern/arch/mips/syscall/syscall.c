@@ -38,12 +38,15 @@
 #include <syscall.h>
 #include <file_syscalls.h>
 #include <proc_syscalls.h>
+#include <thread_syscalls.h>
+#include <futex_syscalls.h>
 #include <copyinout.h>
 #include <uio.h>
 #include <kern/iovec.h>
 #include <endian.h>
 #include <addrspace.h>
 #include <kern/wait.h>
+#include <counter.h>
 
 
 /*
@@ -96,6 +99,7 @@ syscall(struct trapframe *tf)
 	KASSERT(curthread->t_iplhigh_count == 0);
 
 	callno = tf->tf_v0;
+	counter_inc(CNT_SYSCALLS);
 
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
@@ -118,6 +122,11 @@ syscall(struct trapframe *tf)
 				 (userptr_t)tf->tf_a1);
 		break;
 
+	    case SYS_nanosleep:
+		err = sys_nanosleep((const_userptr_t)tf->tf_a0,
+				    (userptr_t)tf->tf_a1);
+		break;
+
 	    /* Add stuff here */
 		case SYS_open:
 		err = open((userptr_t)tf->tf_a0,
@@ -139,35 +148,28 @@ syscall(struct trapframe *tf)
 
 		case SYS_lseek: ;
 		//second argument off_t pos is 64 bits so exists in registers a2/a3
-		uint64_t *pos = kmalloc(sizeof(uint64_t));
-		join32to64(tf->tf_a2, tf->tf_a3, pos);
+		uint64_t pos;
+		join32to64(tf->tf_a2, tf->tf_a3, &pos);
 
 		//third argument int whence exists on the user stack
 		const_userptr_t arg_addr = (const_userptr_t) tf->tf_sp + 16;
 		int whence;
 
-		err = copyin(arg_addr, &whence, 4);
+		err = copyin(arg_addr, &whence, sizeof(whence));
 		if (err) {
 			break;
 		}
 
-		//64 bit return value variable
-		uint64_t *ret_pos = kmalloc(sizeof(off_t));
-		if (ret_pos == NULL) {
-			err = -1;
-			kfree(pos);
+		//perform lseek; the 64 bit temporaries stay on the stack
+		off_t ret_pos;
+		err = lseek(tf->tf_a0, (off_t) pos, whence, &ret_pos);
+		if (err) {
 			break;
 		}
 
-		//perform lseek
-		err = lseek(tf->tf_a0, (off_t) *pos, whence, (off_t *) ret_pos);
-
 		//split 64 bit return value into 2 32 bit values to fit into registers v0 and v1
-    	split64to32(*ret_pos, &tf->tf_v0, &tf->tf_v1);
+		split64to32((uint64_t) ret_pos, &tf->tf_v0, &tf->tf_v1);
 		retval = tf->tf_v0;
-
-		kfree(ret_pos);
-		kfree(pos);
 		break;
 
 		case SYS_chdir:
@@ -186,6 +188,10 @@ syscall(struct trapframe *tf)
 		err = fork(tf, &retval);
 		break;
 
+		case SYS_vfork:
+		err = vfork(tf, &retval);
+		break;
+
 		case SYS_execv:
 		err = execv((const char *) tf->tf_a0, (char **) tf->tf_a1);
 		break;
@@ -202,6 +208,39 @@ syscall(struct trapframe *tf)
 		err = getpid(&retval);
 		break;
 
+		case SYS___thread_create:
+		err = uthread_create((userptr_t) tf->tf_a0, (userptr_t) tf->tf_a1,
+				(userptr_t) tf->tf_a2, tf->tf_gp, &retval);
+		break;
+
+		case SYS_thread_join:
+		err = uthread_join(tf->tf_a0, (userptr_t) tf->tf_a1, &retval);
+		break;
+
+		case SYS_thread_exit:
+		err = uthread_exit(tf->tf_a0);
+		break;
+
+		case SYS_sched_setaffinity:
+		err = sched_setaffinity(tf->tf_a0, tf->tf_a1);
+		break;
+
+		case SYS_sched_getaffinity:
+		err = sched_getaffinity(tf->tf_a0, (userptr_t) tf->tf_a1);
+		break;
+
+		case SYS_sched_getcpu:
+		err = sched_getcpu(&retval);
+		break;
+
+		case SYS_futex_wait:
+		err = futex_wait((userptr_t) tf->tf_a0, tf->tf_a1, tf->tf_a2);
+		break;
+
+		case SYS_futex_wake:
+		err = futex_wake((userptr_t) tf->tf_a0, tf->tf_a1, &retval);
+		break;
+
 	    default:
 		kprintf("Unknown syscall %d\n", callno);
 		err = ENOSYS;
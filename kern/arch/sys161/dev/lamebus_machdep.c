@@ -75,6 +75,25 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+/*
+ * Read the on-chip timer's cycle count.
+ */
+static
+uint32_t
+mips_timer_get(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -118,6 +137,94 @@ mainbus_bootstrap(void)
 	mips_timer_set(CPU_FREQUENCY / HZ);
 }
 
+/*
+ * Tickless idle.
+ *
+ * The periodic code in mainbus_interrupt writes the same compare value
+ * on every tick, so c0_count must get back to zero between one timer
+ * interrupt and the next; but that could be when count reaches
+ * compare or when compare is written, and nothing here depends on
+ * which:
+ *
+ *  - the one-shot's start is the count read just after programming
+ *    it, and time since then is measured from there, modulo 2^32;
+ *  - if the one-shot went off, the time that went by is the length
+ *    programmed, whatever count says now (it may have been reset);
+ *    a count that has wrapped back past the start means the same;
+ *  - mips_timer_ahead checks whether its compare write reset count,
+ *    and if not, programs compare relative to the current count, so
+ *    the new value is always ahead of it.
+ */
+#define TIMER_PERIOD	(CPU_FREQUENCY / HZ)
+/* Leaves room for mips_timer_ahead to add to a count. */
+#define TIMER_MAXPERIODS (0xffffffffU / TIMER_PERIOD - 2)
+
+struct mips_oneshot {
+	uint32_t os_start;		/* c0_count after programming */
+	uint32_t os_cycles;		/* length programmed */
+};
+static struct mips_oneshot mips_oneshots[LB_NSLOTS];
+
+/*
+ * Make the timer go off CYCLES from now.
+ */
+static
+void
+mips_timer_ahead(uint32_t cycles)
+{
+	uint32_t before, after;
+
+	before = mips_timer_get();
+	mips_timer_set(cycles);
+	after = mips_timer_get();
+	if (after >= before) {
+		/* The write didn't reset count. */
+		mips_timer_set(after + cycles);
+	}
+}
+
+/*
+ * Stop the periodic timer interrupt in favor of a single one
+ * HARDCLOCKS periods from now.
+ */
+void
+mainbus_timer_oneshot(unsigned hardclocks)
+{
+	struct mips_oneshot *os;
+
+	os = &mips_oneshots[curcpu->c_hardware_number];
+	if (hardclocks > TIMER_MAXPERIODS) {
+		hardclocks = TIMER_MAXPERIODS;
+	}
+	os->os_cycles = hardclocks * TIMER_PERIOD;
+	mips_timer_ahead(os->os_cycles);
+	os->os_start = mips_timer_get();
+}
+
+/*
+ * Go back to the periodic timer interrupt, and return the number of
+ * periods that went by since mainbus_timer_oneshot. TIMERFIRED says
+ * the one-shot interrupt is what woke us. Otherwise the first period
+ * is shortened by whatever part of one has already gone by, so the
+ * hardclock stays in phase.
+ */
+unsigned
+mainbus_timer_periodic(bool timerfired)
+{
+	struct mips_oneshot *os;
+	uint32_t elapsed;
+
+	os = &mips_oneshots[curcpu->c_hardware_number];
+	elapsed = mips_timer_get() - os->os_start;
+	if (timerfired || elapsed >= os->os_cycles) {
+		/* Writing compare also clears the interrupt, if pending. */
+		mips_timer_ahead(TIMER_PERIOD);
+		return os->os_cycles / TIMER_PERIOD;
+	}
+	mips_timer_ahead(TIMER_PERIOD - elapsed % TIMER_PERIOD);
+	return elapsed / TIMER_PERIOD;
+}
+
 /*
  * Start all secondary CPUs.
  */
@@ -294,6 +401,13 @@ mainbus_interrupt(struct trapframe *tf)
 	KASSERT(curthread->t_curspl > 0);
 
 	cause = tf->tf_cause;
+	if (hardclock_resume((cause & MIPS_TIMER_BIT) != 0)) {
+		/* Waking from tickless idle took care of the timer. */
+		if (cause & MIPS_TIMER_BIT) {
+			cause &= ~MIPS_TIMER_BIT;
+			seen = true;
+		}
+	}
 	if (cause & LAMEBUS_IRQ_BIT) {
 		lamebus_interrupt(lamebus);
 		seen = true;
@@ -363,7 +363,7 @@ config_con(struct con_softc *cs, int unit)
 	if (rsem == NULL) {
 		return ENOMEM;
 	}
-	wsem = sem_create("console write", 1);
+	wsem = sem_create_fifo("console write", 1);
 	if (wsem == NULL) {
 		sem_destroy(rsem);
 		return ENOMEM;
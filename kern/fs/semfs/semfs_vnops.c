@@ -116,9 +116,9 @@ semfs_getsembynum(struct semfs *semfs, unsigned semnum)
 {
 	struct semfs_sem *sem;
 
-	lock_acquire(semfs->semfs_tablelock);
+	rwlock_acquire_read(semfs->semfs_tablelock);
 	sem = semfs_semarray_get(semfs->semfs_sems, semnum);
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_read(semfs->semfs_tablelock);
 
 	return sem;
 }
@@ -414,9 +414,9 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
 		result = ENOMEM;
 		goto fail_unlock;
 	}
-	lock_acquire(semfs->semfs_tablelock);
+	rwlock_acquire_write(semfs->semfs_tablelock);
 	result = semfs_sem_insert(semfs, sem, &semnum);
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_write(semfs->semfs_tablelock);
 	if (result) {
 		goto fail_uncreate;
 	}
@@ -451,9 +451,9 @@ semfs_creat(struct vnode *dirvn, const char *name, bool excl, mode_t mode,
  fail_undent:
 	semfs_direntry_destroy(dent);
  fail_uninsert:
-	lock_acquire(semfs->semfs_tablelock);
+	rwlock_acquire_write(semfs->semfs_tablelock);
 	semfs_semarray_set(semfs->semfs_sems, semnum, NULL);
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_write(semfs->semfs_tablelock);
  fail_uncreate:
 	semfs_sem_destroy(sem);
  fail_unlock:
@@ -494,10 +494,10 @@ semfs_remove(struct vnode *dirvn, const char *name)
 			KASSERT(sem->sems_linked);
 			sem->sems_linked = false;
 			if (sem->sems_hasvnode == false) {
-				lock_acquire(semfs->semfs_tablelock);
+				rwlock_acquire_write(semfs->semfs_tablelock);
 				semfs_semarray_set(semfs->semfs_sems,
 						   dent->semd_semnum, NULL);
-				lock_release(semfs->semfs_tablelock);
+				rwlock_release_write(semfs->semfs_tablelock);
 				lock_release(sem->sems_lock);
 				semfs_sem_destroy(sem);
 			}
@@ -599,7 +599,7 @@ semfs_reclaim(struct vnode *vn)
 	struct semfs_sem *sem;
 	unsigned i, num;
 
-	lock_acquire(semfs->semfs_tablelock);
+	rwlock_acquire_write(semfs->semfs_tablelock);
 
 	/* vnode refcount is protected by the vnode's ->vn_countlock */
 	spinlock_acquire(&vn->vn_countlock);
@@ -608,7 +608,7 @@ semfs_reclaim(struct vnode *vn)
 		vn->vn_refcount--;
 
 		spinlock_release(&vn->vn_countlock);
-		lock_release(semfs->semfs_tablelock);
+		rwlock_release_write(semfs->semfs_tablelock);
 		return EBUSY;
 	}
 
@@ -636,7 +636,7 @@ semfs_reclaim(struct vnode *vn)
 	}
 
 	/* done with the table */
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_write(semfs->semfs_tablelock);
 
 	/* destroy it */
 	semfs_vnode_destroy(semv);
@@ -744,44 +744,73 @@ semfs_vnode_create(struct semfs *semfs, unsigned semnum)
 }
 
 /*
- * Look up the vnode for a semaphore by number; if it doesn't exist,
- * create it.
+ * Find the existing vnode for a semaphore by number, and take a
+ * reference to it. Returns NULL if there isn't one. The caller must
+ * hold the table lock, either way.
  */
-int
-semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
+static
+struct vnode *
+semfs_findvnode(struct semfs *semfs, unsigned semnum)
 {
 	struct vnode *vn;
 	struct semfs_vnode *semv;
-	struct semfs_sem *sem;
 	unsigned i, num;
-	int result;
 
-	/* Lock the vnode table */
-	lock_acquire(semfs->semfs_tablelock);
-
-	/* Look for it */
 	num = vnodearray_num(semfs->semfs_vnodes);
 	for (i=0; i<num; i++) {
 		vn = vnodearray_get(semfs->semfs_vnodes, i);
 		semv = vn->vn_data;
 		if (semv->semv_semnum == semnum) {
 			VOP_INCREF(vn);
-			lock_release(semfs->semfs_tablelock);
-			*ret = vn;
-			return 0;
+			return vn;
 		}
 	}
+	return NULL;
+}
+
+/*
+ * Look up the vnode for a semaphore by number; if it doesn't exist,
+ * create it.
+ */
+int
+semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
+{
+	struct vnode *vn;
+	struct semfs_vnode *semv;
+	struct semfs_sem *sem;
+	int result;
+
+	/*
+	 * Look for it. This is the common case, so do it with only a
+	 * read hold; if it isn't there, get a write hold and look
+	 * again, since somebody else may have made it in between.
+	 */
+	rwlock_acquire_read(semfs->semfs_tablelock);
+	vn = semfs_findvnode(semfs, semnum);
+	rwlock_release_read(semfs->semfs_tablelock);
+	if (vn != NULL) {
+		*ret = vn;
+		return 0;
+	}
+
+	rwlock_acquire_write(semfs->semfs_tablelock);
+	vn = semfs_findvnode(semfs, semnum);
+	if (vn != NULL) {
+		rwlock_release_write(semfs->semfs_tablelock);
+		*ret = vn;
+		return 0;
+	}
 
 	/* Make it */
 	semv = semfs_vnode_create(semfs, semnum);
 	if (semv == NULL) {
-		lock_release(semfs->semfs_tablelock);
+		rwlock_release_write(semfs->semfs_tablelock);
 		return ENOMEM;
 	}
 	result = vnodearray_add(semfs->semfs_vnodes, &semv->semv_absvn, NULL);
 	if (result) {
 		semfs_vnode_destroy(semv);
-		lock_release(semfs->semfs_tablelock);
+		rwlock_release_write(semfs->semfs_tablelock);
 		return ENOMEM;
 	}
 	if (semnum != SEMFS_ROOTDIR) {
@@ -790,7 +819,7 @@ semfs_getvnode(struct semfs *semfs, unsigned semnum, struct vnode **ret)
 		KASSERT(sem->sems_hasvnode == false);
 		sem->sems_hasvnode = true;
 	}
-	lock_release(semfs->semfs_tablelock);
+	rwlock_release_write(semfs->semfs_tablelock);
 
 	*ret = &semv->semv_absvn;
 	return 0;
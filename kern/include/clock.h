@@ -56,6 +56,20 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle. If hardclock_tickless is set, an idle cpu stops its
+ * periodic hardclock in hardclock_idle(), just before idling, and
+ * asks for a single interrupt when it next has work to do instead.
+ * The bus code calls hardclock_resume() on every interrupt; if the
+ * cpu was tickless, it restarts the periodic tick and catches up on
+ * the hardclocks that were skipped, and returns true. TIMERFIRED says
+ * whether this interrupt is the timer's; if so it has been dealt
+ * with.
+ */
+extern bool hardclock_tickless;
+void hardclock_idle(void);
+bool hardclock_resume(bool timerfired);
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
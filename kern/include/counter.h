@@ -0,0 +1,56 @@
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+/*
+ * Per-cpu event counters.
+ *
+ * Each cpu has its own copy of every counter (in struct cpu), and
+ * only ever updates its own, so counting an event costs no lock, no
+ * atomic operation, and no cache line shared with other cpus. To get
+ * the total, counter_sum adds up all the cpus' copies on demand.
+ *
+ * Updates turn interrupts off for the duration, so an interrupt
+ * handler counting the same event can't lose an update, and the
+ * thread can't be moved to another cpu halfway through. Reads take no
+ * precautions at all: another cpu's counter may be mid-update, so a
+ * sum is only a snapshot. They're statistics.
+ *
+ * To add a counter, add it to the enum here and give it a name in
+ * counter.c.
+ */
+
+struct cpu;	/* in <cpu.h> */
+
+enum counter {
+	CNT_HARDCLOCKS,		/* hardclock() calls */
+	CNT_TICKS_AVOIDED,	/* hardclocks skipped while idle */
+	CNT_SWITCHES,		/* context switches */
+	CNT_MIGRATIONS,		/* threads moved between cpus */
+	CNT_WAKEUPS_AFFINE,	/* wakeups sent to the sleeper's last cpu */
+	CNT_WAKEUPS_IDLE,	/* wakeups sent to an idle cpu */
+	CNT_SYSCALLS,		/* system calls */
+	CNT_KMALLOC,		/* kmalloc calls */
+	CNT_KMALLOC_PAGES,	/* ... that took whole pages */
+	CNT_KMALLOC_FAILED,	/* ... that failed */
+	CNT_KFREE,		/* kfree calls */
+	CNT_NUM
+};
+
+/*
+ * counter_inc/counter_add count events on the current cpu. They do
+ * nothing before the first cpu is set up.
+ *
+ * counter_get returns one cpu's count, counter_sum the total over all
+ * cpus. counter_name is for printing.
+ *
+ * counter_printall prints every counter, total and per cpu.
+ */
+void counter_inc(enum counter cnt);
+void counter_add(enum counter cnt, uint64_t n);
+uint64_t counter_get(const struct cpu *c, enum counter cnt);
+uint64_t counter_sum(enum counter cnt);
+const char *counter_name(enum counter cnt);
+void counter_printall(void);
+
+
+#endif /* _COUNTER_H_ */
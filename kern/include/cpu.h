@@ -33,9 +33,25 @@
 
 #include <spinlock.h>
 #include <threadlist.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <counter.h>
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/*
+ * Histogram of scheduling delays. Bucket 0 counts delays under 2
+ * microseconds; bucket N counts delays of 2^N to 2^(N+1)-1
+ * microseconds; the last bucket also counts everything longer.
+ */
+#define SCHEDHIST_BUCKETS 16
+
+struct schedhist {
+	unsigned sh_count;		/* Number of samples */
+	uint64_t sh_total;		/* Sum of samples (ns) */
+	unsigned sh_buckets[SCHEDHIST_BUCKETS];
+};
+
 /*
  * Per-cpu structure
  *
@@ -59,8 +75,11 @@ struct cpu {
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
-	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	struct threadlist c_threadcache; /* Exited threads kept for reuse */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
+	bool c_tickless;		/* Periodic hardclock is stopped */
+	struct schedhist c_rqdelay;	/* Time threads waited to run */
+	struct schedhist c_slice;	/* Time threads ran before switching */
 
 	/*
 	 * Accessed by other cpus.
@@ -70,6 +89,32 @@ struct cpu {
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
 	struct spinlock c_runqueue_lock;
 
+	/*
+	 * Accessed by other cpus.
+	 * Protected by the wheel's own lock.
+	 */
+	struct timerwheel c_timers;	/* Pending timers (see timer.h) */
+
+	/*
+	 * Accessed by other cpus.
+	 * Protected by the queue's own lock.
+	 */
+	struct workqueue c_workq;	/* Deferred work (see workqueue.h) */
+
+	/*
+	 * Written only by this cpu; read by others without locking.
+	 */
+	uint64_t c_counters[CNT_NUM];	/* Event counts (see counter.h) */
+
+	/*
+	 * Accessed by other cpus, without locking (see rcu.c).
+	 * c_rcu_qs and c_rcu_idle are only written by this cpu, and
+	 * c_rcu_snap only under the RCU lock.
+	 */
+	volatile unsigned c_rcu_qs;	/* Quiescent states passed */
+	unsigned c_rcu_snap;		/* c_rcu_qs when grace period began */
+	volatile bool c_rcu_idle;	/* In cpu_idle, not in an interrupt */
+
 	/*
 	 * Accessed by other cpus.
 	 * Protected by the IPI lock.
@@ -110,6 +155,21 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Sets of cpus, as used for thread affinity: one bit per c_number.
+ * (There are at most 32 cpus.)
+ */
+#define CPUMASK_ALL		0xffffffffU
+#define CPUMASK_BIT(c)		(1U << (c)->c_number)
+#define CPUMASK_HAS(mask, c)	(((mask) & CPUMASK_BIT(c)) != 0)
+
+/*
+ * Look up cpus by number (c_number), from 0 to cpu_count()-1.
+ * Cpus are never removed, so the results stay valid.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_get(unsigned num);
+
 /*
  * Produce a string describing the CPU type.
  */
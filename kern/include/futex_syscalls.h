@@ -0,0 +1,20 @@
+#ifndef _FUTEX_SYSCALLS_H_
+#define _FUTEX_SYSCALLS_H_
+
+#include <cdefs.h>
+
+struct proc;
+
+/*
+ * futex syscall functions
+ */
+int futex_wait(userptr_t addr, int val, unsigned msecs);
+int futex_wake(userptr_t addr, int count, int *retval);
+
+/*
+ * setup, and exit support: wake every waiter in PROC
+ */
+void futex_bootstrap(void);
+void futex_wakeproc(struct proc *proc);
+
+#endif
@@ -197,6 +197,16 @@
 #define SYS_reboot       119
 //#define SYS___sysctl   120
 
+//                              -- Threads --
+#define SYS___thread_create 121
+#define SYS_thread_join  122
+#define SYS_thread_exit  123
+#define SYS_sched_setaffinity 124
+#define SYS_sched_getaffinity 125
+#define SYS_futex_wait   126
+#define SYS_futex_wake   127
+#define SYS_sched_getcpu 128
+
 /*CALLEND*/
 
 
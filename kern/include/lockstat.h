@@ -0,0 +1,66 @@
+#ifndef _LOCKSTAT_H_
+#define _LOCKSTAT_H_
+
+/*
+ * Lock contention statistics.
+ *
+ * Only built with "options lockstat". Each sleep lock and spinlock
+ * points at a record of counters, shared by all locks of the same
+ * class: sleep locks are grouped by name, spinlocks by where they were
+ * initialized (spinlock_init's caller) or, for statically initialized
+ * ones, by their own address. Both show up as kernel addresses in the
+ * report; look them up in the kernel's symbol table.
+ *
+ * Since several locks of one class can be busy at once on different
+ * cpus, each record has a lock word of its own, held just long enough
+ * to update the counters; the 64-bit times couldn't be updated in one
+ * go on a 32-bit machine anyway.
+ *
+ * Times are only collected once lockstat_start has been called, which
+ * has to wait until there's a clock.
+ */
+
+#include <machine/spinlock.h>	/* for spinlock_data_t */
+#include "opt-lockstat.h"
+
+#define LOCKSTAT_NAMELEN	24
+
+struct lockstat {
+	char ls_name[LOCKSTAT_NAMELEN];	/* class name; "" if slot free */
+	bool ls_spin;			/* spinlocks, not sleep locks */
+	volatile spinlock_data_t ls_lock; /* guards the counters */
+	unsigned ls_acquires;		/* times acquired */
+	unsigned ls_contended;		/* times we had to wait */
+	uint64_t ls_waitns;		/* total time waited */
+	uint64_t ls_maxholdns;		/* longest time held */
+};
+
+/*
+ * Find or make the record for a class; NULL if the table is full.
+ * lockstat_getspin is for spinlocks, keyed by address; it returns
+ * NULL until collection starts, so that the record gets looked up
+ * again later.
+ */
+struct lockstat *lockstat_get(const char *name, bool spin);
+struct lockstat *lockstat_getspin(const void *key);
+
+/* Timestamp in nanoseconds, or 0 if we aren't collecting yet. */
+uint64_t lockstat_now(void);
+
+/*
+ * Hooks for the lock code. lockstat_acquired is called with the lock
+ * held; WAITSTART is the time we started waiting if we had to (0 if
+ * not). It returns the hold start time to pass to lockstat_released.
+ */
+uint64_t lockstat_acquired(struct lockstat *ls, uint64_t waitstart);
+void lockstat_released(struct lockstat *ls, uint64_t holdstart);
+
+/* Start collecting, from boot once the clock is attached. */
+void lockstat_start(void);
+
+/* Print the records, most time spent waiting first; or clear them. */
+void lockstat_print(void);
+void lockstat_reset(void);
+
+
+#endif /* _LOCKSTAT_H_ */
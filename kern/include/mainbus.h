@@ -55,6 +55,17 @@ size_t mainbus_ramsize(void);
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
+/*
+ * Hardclock timer control, for tickless idle. mainbus_timer_oneshot
+ * replaces the current cpu's periodic hardclock interrupt with a
+ * single one HARDCLOCKS from now; mainbus_timer_periodic puts the
+ * periodic interrupt back and returns how many hardclock periods went
+ * by in between. TIMERFIRED says whether the single interrupt is the
+ * one being handled.
+ */
+void mainbus_timer_oneshot(unsigned hardclocks);
+unsigned mainbus_timer_periodic(bool timerfired);
+
 /*
  * The various ways to shut down the system. (These are very low-level
  * and should generally not be called directly - md_poweroff, for
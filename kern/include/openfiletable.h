@@ -15,7 +15,7 @@ struct open_file;
 struct open_file_table
 {
 	struct open_file *table[OPEN_MAX];
-	struct lock *table_lock;
+	struct rwlock *table_lock;	/* fd lookups read, changes write */
 };
 
 
@@ -33,7 +33,7 @@ void open_file_table_destroy(struct open_file_table *oft);
 int special_fd_create(struct open_file_table *oft);
 
 /*
- * copy contents of old_oft to new_oft
+ * copy contents of old_oft to new_oft, closing whatever new_oft had open
  */
 int open_file_table_copy(struct open_file_table *old_oft, struct open_file_table *new_oft);
 
@@ -4,6 +4,7 @@
 #include <types.h>
 #include <synch.h>
 #include <limits.h>
+#include <rcu.h>
 
 /*
  * Structure representing a pid entry in the pid table; associated with one process
@@ -11,11 +12,10 @@
 struct pid
 {
 
-	pid_t parentPid;				/* pid of the parent of associated process */
-	struct semaphore *exitLock;		/* lock used to signal to blocking parent that associated process has exited */
+	struct proc *proc;				/* the associated process */
 
-	bool exitFlag;					/* associated process has exited */
-	int exitStatus;					/* exitCode called on associated process to exit */
+	struct rcu_head rcu;			/* for freeing it and the process once
+						   readers are done */
 };
 
 
@@ -46,6 +46,18 @@ struct vnode;
 
 struct open_file;
 struct open_file_table;
+struct proc;
+
+/*
+ * A list of processes, linked through p_sibnext/p_sibprevp. Each
+ * process is on exactly one of its parent's lists, p_children while
+ * it runs and p_zombies once it has exited, so it can be moved or
+ * taken off in constant time.
+ */
+struct proclist {
+	struct proc *pl_head;		/* first (oldest) entry */
+	struct proc **pl_tailp;		/* where to link the next one */
+};
 
 /*
  * Process structure.
@@ -61,12 +73,34 @@ struct proc {
 	/* VFS */
 	struct vnode *p_cwd;		/* current working directory */
 
+	/* Scheduling */
+	unsigned p_cpumask;		/* cpus our threads may run on */
+
 	struct open_file_table *oft;
 
 	pid_t pid;
-	struct lock *childProcsLock;
-	struct array *childProcs;
-	bool parentDead;
+
+	/* Process tree; see proc.c for what each lock covers */
+	struct lock *p_familylock;	/* our children and their links */
+	struct proc *p_parent;		/* NULL once orphaned */
+	struct proc *p_sibnext;		/* next on parent's list */
+	struct proc **p_sibprevp;	/* what points to us there */
+	struct proclist p_children;	/* children still running */
+	struct proclist p_zombies;	/* exited children, oldest first */
+	struct cv *p_childcv;		/* signalled when a child exits */
+	bool p_exited;			/* on parent's p_zombies */
+	int p_exitstatus;		/* encoded as for waitpid */
+	bool *p_vforkdone;		/* non-NULL while borrowing the
+					   vfork parent's address space */
+
+	/* User-level threads; see thread_syscalls.c */
+	struct lock *p_uthreadlock;	/* protects the fields below */
+	struct cv *p_uthreadcv;		/* signalled when a thread exits */
+	struct array *p_uthreads;	/* struct uthread records */
+	int p_nexttid;			/* next thread id to hand out */
+	unsigned p_nlive;		/* threads not yet exiting */
+	unsigned p_nattached;		/* threads still in p_threads */
+	volatile bool p_exiting;	/* other threads must exit */
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
@@ -87,6 +121,45 @@ int proc_addthread(struct proc *proc, struct thread *t);
 /* Detach a thread from its process. */
 void proc_remthread(struct thread *t);
 
+/*
+ * Set the cpus the process's threads may run on (a CPUMASK_* set, see
+ * cpu.h). Cpus that don't exist are ignored; fails with EINVAL if that
+ * leaves none. Threads already on a cpu no longer allowed move the
+ * next time they return to user mode.
+ */
+int proc_setaffinity(struct proc *proc, unsigned mask);
+
+/*
+ * Process tree functions.
+ *
+ * proc_orphanchildren - on exit: destroy PROC's unreaped children and
+ *                       disown the ones still running.
+ * proc_zombify        - on exit, after the last thread has detached:
+ *                       record STATUS and put PROC on its parent's
+ *                       zombie list. Returns false, leaving PROC
+ *                       alone, if it has no parent to reap it; the
+ *                       caller should destroy it.
+ * proc_waitchild      - reap an exited child of the current process:
+ *                       PID, or any child for WAIT_ANY. OPTIONS may
+ *                       be WNOHANG, in which case *RETPID is 0 if no
+ *                       suitable child has exited yet.
+ * proc_getchild       - the running or exited child of the current
+ *                       process with pid PID, or NULL. Hold
+ *                       curproc's p_familylock while using the
+ *                       result.
+ * proc_vforkwait      - in a vfork parent, wait until *DONE is set.
+ * proc_vforkdone      - in a vforked child that has stopped using the
+ *                       parent's address space: set the parent's
+ *                       flag and wake it. Does nothing if PROC isn't
+ *                       borrowing an address space.
+ */
+void proc_orphanchildren(struct proc *proc);
+bool proc_zombify(struct proc *proc, int status);
+int proc_waitchild(pid_t pid, int options, pid_t *retpid, int *status);
+struct proc *proc_getchild(pid_t pid);
+void proc_vforkwait(bool *done);
+void proc_vforkdone(struct proc *proc);
+
 /* Fetch the address space of the current process. */
 struct addrspace *proc_getas(void);
 
@@ -99,14 +172,6 @@ struct addrspace *proc_setas(struct addrspace *);
  */
 void destroy_pid_entry(pid_t pidIndex);
 
-void set_pid_exitFlag(pid_t pidIndex, bool exitFlag);
-bool get_pid_exitFlag(pid_t pidIndex);
-
-void set_pid_exitStatus(pid_t pidIndex, int exitStatus);
-int get_pid_exitStatus(pid_t pidIndex);
-
 bool get_pid_in_table(pid_t pidIndex);
-pid_t get_parent_pid(pid_t pidIndex);
-struct semaphore *get_exitLock(pid_t pidIndex);
 
 #endif /* _PROC_H_ */
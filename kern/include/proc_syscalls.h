@@ -10,10 +10,14 @@
  * process syscall functions
  */
 int fork(struct trapframe *tf, int *retval);
+int vfork(struct trapframe *tf, int *retval);
 int execv(const char *program, char **args);
 int waitpid(int pid, userptr_t status, int options, int *retval);
 int _exit(int exitcode);
 int getpid(int *retval);
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, userptr_t mask);
+int sched_getcpu(int *retval);
 
 // helper functions
 void kfree_buf(char **buf, int len);
@@ -0,0 +1,53 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Read-copy-update: lock-free readers, deferred reclamation.
+ *
+ * Readers of an RCU-protected structure bracket their accesses with
+ * rcu_read_lock and rcu_read_unlock, and take no locks. Writers still
+ * serialize among themselves with an ordinary lock. A writer that
+ * takes something out of the structure must not free it while a
+ * reader might still be looking at it; it hands it to rcu_defer
+ * instead, which calls the given function once every reader that
+ * could have seen it is done.
+ *
+ * A read-side section runs with interrupts off, so it can't be
+ * preempted, and must not sleep. Then any cpu that context switches,
+ * takes a hardclock, or sits idle is outside any read-side section;
+ * that's a quiescent state. Once every cpu has passed through one
+ * since the item was removed, nobody can still be holding it. This
+ * makes readers very cheap: no atomic operations and no shared writes.
+ *
+ * Deferred functions run later from a workqueue, in thread context,
+ * and may sleep. rcu_quiescent is for the scheduler and hardclock;
+ * rcu_idle_enter and rcu_idle_exit are for the idle loop, and
+ * rcu_idle_exit for interrupt entry too.
+ */
+
+#include <membar.h>
+
+struct rcu_head {
+	struct rcu_head *rh_next;	/* next waiting */
+	void (*rh_func)(void *);	/* function to call */
+	void *rh_data;			/* argument for it */
+};
+
+int rcu_read_lock(void);		/* returns spl for rcu_read_unlock */
+void rcu_read_unlock(int spl);
+
+void rcu_defer(struct rcu_head *rh, void (*func)(void *), void *data);
+
+void rcu_quiescent(void);
+void rcu_idle_enter(void);
+void rcu_idle_exit(void);
+void rcu_bootstrap(void);
+
+/*
+ * Publish a pointer for readers: everything the writer did to set up
+ * the object it points to is visible before the pointer is.
+ */
+#define rcu_assign(ptr, val) (membar_store_store(), (ptr) = (val))
+
+
+#endif /* _RCU_H_ */
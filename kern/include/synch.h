@@ -36,21 +36,37 @@
 
 
 #include <spinlock.h>
+#include <thread.h>	/* for THREAD_NPRIO */
+
+struct sem_waiter;	/* Opaque; in synch.c. */
 
 /*
  * Dijkstra-style semaphore.
  *
  * The name field is for easier debugging. A copy of the name is made
  * internally.
+ *
+ * Ordinary semaphores don't keep waiters in order: V wakes one, which
+ * then has to compete for the count with anyone else calling P, and
+ * may lose and go back to sleep at the end of the line. A handoff
+ * semaphore (sem_create_fifo) is strictly FIFO instead: while anyone
+ * is waiting, V gives its unit directly to the oldest waiter, and a
+ * new P gets in line behind them rather than taking it. Use it for busy
+ * semaphores where waits should be bounded.
  */
 struct semaphore {
 	char *sem_name;
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
 	volatile unsigned sem_count;
+	bool sem_fifo;			/* handoff mode */
+	struct sem_waiter *sem_head;	/* handoff: waiters, oldest first */
+	struct sem_waiter **sem_tailp;	/* handoff: where to link the next */
+	unsigned sem_nwaiting;		/* handoff: waiters in line */
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
+struct semaphore *sem_create_fifo(const char *name, unsigned initial_count);
 void sem_destroy(struct semaphore *);
 
 /*
@@ -58,9 +74,13 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ *     P_timed: like P, but give up after MSECS milliseconds. Returns
+ *              0 if the count was decremented, ETIMEDOUT otherwise.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
+int P_timed(struct semaphore *, unsigned msecs);
 
 
 /*
@@ -71,12 +91,23 @@ void V(struct semaphore *);
  *
  * The name field is for easier debugging. A copy of the name is
  * (should be) made internally.
+ *
+ * Locks do priority inheritance: while higher-priority threads are
+ * waiting, the holder runs at the best of their priorities. See
+ * synch.c.
  */
 struct lock {
         char *lk_name;
 	struct wchan *lk_wchan;
 	struct spinlock lk_lock;
 	struct thread *volatile lk_holder;
+	struct lock *lk_nextheld;	/* holder's t_heldlocks list */
+	unsigned lk_nwaiters;		/* threads asleep waiting */
+	unsigned lk_waiters[THREAD_NPRIO]; /* same, by priority level */
+#if OPT_LOCKSTAT
+	struct lockstat *lk_stat;	/* contention statistics */
+	uint64_t lk_holdstart;		/* when acquired */
+#endif
 };
 
 struct lock *lock_create(const char *name);
@@ -97,6 +128,15 @@ void lock_acquire(struct lock *);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
 
+/*
+ * Locks are adaptive: a thread that finds the lock held by a thread
+ * running on another cpu spins for a while before sleeping, since
+ * short critical sections are usually over before a context switch
+ * would be. Clearing lock_spinning makes waiters always sleep, for
+ * comparison (see the sy5 benchmark).
+ */
+extern bool lock_spinning;
+
 
 /*
  * Condition variable.
@@ -114,8 +154,7 @@ bool lock_do_i_hold(struct lock *);
 
 struct cv {
         char *cv_name;
-	struct wchan *cv_wchan;
-	struct spinlock cv_wchanlock;
+	struct wchan *cv_wchan;		/* protected by the lock's lk_lock */
 };
 
 struct cv *cv_create(const char *name);
@@ -127,16 +166,66 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_timedwait - Like cv_wait, but wake up anyway after MSECS
+ *                   milliseconds. Returns ETIMEDOUT if it timed out,
+ *                   0 otherwise. Like cv_wait, may wake spuriously.
  *
- * For all three operations, the current thread must hold the lock passed
- * in. Note that under normal circumstances the same lock should be used
- * on all operations with any particular CV.
+ * For all of these operations, the current thread must hold the lock passed
+ * in. The CV's wait channel is protected by that lock's spinlock, so
+ * the same lock must be used on all operations with any particular CV.
  *
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
+int cv_timedwait(struct cv *cv, struct lock *lock, unsigned msecs);
+
+
+/*
+ * Reader-writer lock.
+ *
+ * Any number of readers can hold the lock at once, or one writer.
+ * Writers get preference: once a writer is waiting, new readers wait
+ * behind it. Neither side starves, though; when a writer releases the
+ * lock every reader waiting at the time gets in before the next
+ * writer, and writers go in the order they arrived.
+ *
+ * For tables that are looked up far more often than they change.
+ * Not recursive, and there is no upgrading a read hold to a write
+ * hold; release and reacquire (and recheck) instead.
+ */
+struct rwlock {
+	char *rw_name;
+	struct wchan *rw_readwchan;	/* readers sleep here */
+	struct wchan *rw_writewchan;	/* writers sleep here */
+	struct spinlock rw_lock;	/* protects the following */
+	unsigned rw_readers;		/* readers holding the lock */
+	unsigned rw_readwaiting;	/* readers waiting for a writer */
+	unsigned rw_readgen;		/* bumped when those are let in */
+	struct thread *rw_writer;	/* writer holding the lock */
+	unsigned rw_nextticket;		/* next writer ticket to hand out */
+	unsigned rw_serving;		/* ticket of writer allowed in */
+};
+
+struct rwlock *rwlock_create(const char *name);
+void rwlock_destroy(struct rwlock *);
+
+/*
+ * Operations:
+ *    rwlock_acquire_read  - Get the lock for reading.
+ *    rwlock_release_read  - Release a read hold.
+ *    rwlock_acquire_write - Get the lock for writing.
+ *    rwlock_release_write - Release a write hold.
+ *    rwlock_do_i_hold_write - Return true if the current thread holds
+ *                   the lock for writing. (Read holds aren't tracked
+ *                   per thread.)
+ */
+void rwlock_acquire_read(struct rwlock *);
+void rwlock_release_read(struct rwlock *);
+void rwlock_acquire_write(struct rwlock *);
+void rwlock_release_write(struct rwlock *);
+bool rwlock_do_i_hold_write(struct rwlock *);
 
 
 #endif /* _SYNCH_H_ */
@@ -51,6 +51,10 @@ void enter_forked_process(struct trapframe *tf);
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
 
+/* Enter user mode as a new thread of the current process. */
+__DEAD void enter_new_thread(userptr_t arg, vaddr_t stackptr,
+			     vaddr_t entrypoint, vaddr_t gp);
+
 
 /*
  * Prototypes for IN-KERNEL entry points for system call implementations.
@@ -58,6 +62,7 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(const_userptr_t user_req, userptr_t user_rem);
 
 
 #endif /* _SYSCALL_H_ */
@@ -53,9 +53,16 @@ int threadtest(int, char **);
 int threadtest2(int, char **);
 int threadtest3(int, char **);
 int semtest(int, char **);
+int semtest2(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int lockbench(int, char **);
+int rwtest(int, char **);
+int spinlocktest(int, char **);
+int timertest(int, char **);
+int wqtest(int, char **);
+int rcutest(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
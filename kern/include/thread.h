@@ -56,6 +56,14 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * Scheduler priority levels. Level 0 is the highest priority; threads
+ * that use up their quantum sink toward THREAD_PRIO_MIN.
+ */
+#define THREAD_NPRIO		4
+#define THREAD_PRIO_MAX		0
+#define THREAD_PRIO_MIN		(THREAD_NPRIO - 1)
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -79,10 +87,33 @@ struct thread {
 	 */
 	struct thread_machdep t_machdep; /* Any machine-dependent goo */
 	struct threadlistnode t_listnode; /* Link for run/sleep/zombie lists */
+	struct wchan *t_wchan;		/* Wait channel we're on, if any;
+					   protected by its spinlock */
 	void *t_stack;			/* Kernel-level stack */
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_cpumask;		/* CPUs we may run on (CPUMASK_*) */
+
+	/*
+	 * Scheduler fields. Protected by t_cpu's run queue lock while
+	 * the thread is runnable or running.
+	 */
+	unsigned t_priority;		/* MLFQ level (0 is highest) */
+	unsigned t_ticks;		/* Hardclocks used at this level */
+	unsigned t_sleepstamp;		/* t_cpu's CNT_HARDCLOCKS at last sleep */
+	uint64_t t_readystamp;		/* When last made runnable (ns) */
+	uint64_t t_runstamp;		/* When last switched to (ns) */
+	unsigned t_boost;		/* Inherited level, or THREAD_NPRIO */
+
+	/*
+	 * Priority inheritance fields; see synch.c. t_heldlocks is only
+	 * touched by the thread itself; the others are protected by
+	 * synch.c's lock_pilock.
+	 */
+	struct lock *t_heldlocks;	/* Sleep locks we hold */
+	struct lock *t_waitlock;	/* Sleep lock we're waiting for */
+	unsigned t_waitprio;		/* Level we're counted at there */
 
 	/*
 	 * Interrupt state fields.
@@ -144,6 +175,14 @@ int thread_fork(const char *name, struct proc *proc,
                 void (*func)(void *, unsigned long),
                 void *data1, unsigned long data2);
 
+/*
+ * Same, but the new thread runs on cpu C and is never migrated; for
+ * per-cpu kernel threads. (Its affinity mask is just C.)
+ */
+int thread_fork_bound(struct cpu *c, const char *name, struct proc *proc,
+                      void (*func)(void *, unsigned long),
+                      void *data1, unsigned long data2);
+
 /*
  * Cause the current thread to exit.
  * Interrupts need not be disabled.
@@ -157,16 +196,60 @@ __DEAD void thread_exit(void);
  */
 void thread_yield(void);
 
+/*
+ * Charge the current thread for a timer tick. Returns true if it
+ * should yield the processor. Called from the timer interrupt.
+ */
+bool thread_tick(void);
+
 /*
  * Reshuffle the run queue. Called from the timer interrupt.
  */
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Priority inheritance support for the lock code.
+ *
+ * thread_effpriority - the level T is scheduled at: its own, or the
+ *                      one it's been lent (t_boost) if that's higher.
+ * thread_setboost    - set T's lent level (THREAD_NPRIO for none),
+ *                      moving it in its run queue if it's waiting
+ *                      there.
+ */
+unsigned thread_effpriority(const struct thread *t);
+void thread_setboost(struct thread *t, unsigned boost);
+
+/*
+ * Potentially pull ready threads over from busier CPUs. Called from
+ * the timer interrupt. (Idle CPUs also steal work on their own.)
  */
 void thread_consider_migration(void);
 
+/*
+ * Affinity. Each thread has a mask of the cpus it may run on
+ * (t_cpumask); for user threads it comes from the process (see
+ * proc_setaffinity). Migration and wakeups respect it. A thread that
+ * finds itself on a cpu not in its mask (because the mask changed
+ * under it) moves when it calls thread_checkaffinity, which may
+ * sleep; thread_affinity_ok says whether it needs to. User threads
+ * do this on the way back to user mode.
+ */
+bool thread_affinity_ok(void);
+void thread_checkaffinity(void);
+
+/*
+ * Print per-cpu clock and wakeup statistics.
+ */
+void thread_cpustats(void);
+
+/*
+ * Scheduler statistics. thread_schedstats_start turns on collection
+ * once there's a clock to timestamp with. thread_schedstats returns
+ * a report in a kmalloc'd string, whose length is put in *LENRET, or
+ * NULL if out of memory.
+ */
+void thread_schedstats_start(void);
+char *thread_schedstats(size_t *lenret);
+
 
 #endif /* _THREAD_H_ */
@@ -0,0 +1,34 @@
+#ifndef _THREAD_SYSCALLS_H_
+#define _THREAD_SYSCALLS_H_
+
+#include <cdefs.h>
+
+struct thread;
+
+/*
+ * record of a user-level thread, kept in its process's p_uthreads
+ * until somebody joins it
+ */
+struct uthread {
+    int ut_tid;                 // thread id handed back to userland
+    struct thread *ut_thread;   // kernel thread, NULL once exited
+    bool ut_exited;             // thread has exited and detached
+    int ut_status;              // its exit status
+};
+
+/*
+ * user thread syscall functions
+ */
+int uthread_create(userptr_t entry, userptr_t arg, userptr_t stack,
+                   vaddr_t gp, int *retval);
+int uthread_join(int tid, userptr_t status, int *retval);
+int uthread_exit(int status);
+
+/*
+ * exit/exec support
+ */
+void uthread_killothers(void);
+bool uthread_exitpending(void);
+void uthread_exitcheck(void);
+
+#endif
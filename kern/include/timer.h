@@ -0,0 +1,112 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+/*
+ * Kernel timers.
+ *
+ * A timer calls a function once, a given number of hardclocks from
+ * when it is added. Each cpu keeps its pending timers in a
+ * hierarchical timing wheel that hardclock() advances; adding,
+ * cancelling, and expiring a timer are all constant time.
+ *
+ * Timer functions are called from hardclock(), in interrupt context,
+ * with the wheel's lock held. They must not sleep, and must not add
+ * or cancel timers themselves.
+ */
+
+#include <spinlock.h>
+
+struct timespec;	/* in <kern/time.h> */
+struct wchan;		/* in <wchan.h> */
+struct thread;		/* in <thread.h> */
+
+/* Wheel geometry: TIMER_LEVELS levels of TIMER_SLOTS slots each. */
+#define TIMER_SLOTBITS	6
+#define TIMER_SLOTS	(1U << TIMER_SLOTBITS)
+#define TIMER_LEVELS	4
+
+struct timerwheel;
+
+struct timer {
+	struct timer *tm_next;		/* next in wheel slot */
+	struct timer **tm_prevp;	/* pointer that points to us */
+	struct timerwheel *tm_wheel;	/* wheel we were last added to */
+	unsigned tm_expires;		/* expiry, in the wheel's ticks */
+	bool tm_pending;		/* true while on the wheel */
+	void (*tm_func)(void *);	/* function to call */
+	void *tm_data;			/* argument for it */
+};
+
+struct timerwheel {
+	struct spinlock tw_lock;
+	unsigned tw_now;		/* ticks processed so far */
+	unsigned tw_count;		/* number of pending timers */
+	struct timer *tw_slots[TIMER_LEVELS][TIMER_SLOTS];
+};
+
+/*
+ * Per-cpu wheel setup. timerwheel_tick is called by hardclock; it
+ * advances the current cpu's wheel and runs whatever timers expire.
+ */
+void timerwheel_init(struct timerwheel *tw);
+void timerwheel_cleanup(struct timerwheel *tw);
+void timerwheel_tick(void);
+
+/*
+ * Return the number of ticks, up to MAX, until the wheel next needs
+ * attention: the next timer expiry or cascade. For tickless idle.
+ */
+unsigned timerwheel_idleticks(struct timerwheel *tw, unsigned max);
+
+/*
+ * Timer functions.
+ *
+ * timer_init   - set up a timer that will call FUNC(DATA).
+ * timer_add    - arm the timer to go off TICKS hardclocks from now
+ *                (at least one), on the current cpu. The timer must
+ *                not already be pending.
+ * timer_cancel - disarm the timer if it hasn't gone off yet. Returns
+ *                true if it was pending. Once this returns, the timer
+ *                function is not running and won't be called.
+ *                Must not be called with a spinlock that a timer
+ *                function takes held.
+ *
+ * timer_mstoticks - convert milliseconds to hardclocks, rounding up.
+ * timer_tstoticks - same for a timespec.
+ */
+void timer_init(struct timer *tm, void (*func)(void *), void *data);
+void timer_add(struct timer *tm, unsigned ticks);
+bool timer_cancel(struct timer *tm);
+
+unsigned timer_mstoticks(unsigned msecs);
+unsigned timer_tstoticks(const struct timespec *ts);
+
+/*
+ * Timed sleeps.
+ *
+ * timedwait_start arms a timer that will wake the current thread if
+ * it is asleep on WC (whose spinlock is LK) when TICKS hardclocks
+ * pass, and set td_expired. Call it *before* acquiring LK, then sleep
+ * as usual, checking td_expired (under LK) each time before going to
+ * sleep. After releasing LK, call timedwait_finish, which cancels the
+ * timer and returns whether it went off.
+ *
+ * timer_sleep just sleeps for TICKS hardclocks.
+ */
+struct timedwait {
+	struct timer td_timer;
+	struct wchan *td_wchan;
+	struct spinlock *td_lock;
+	struct thread *td_thread;
+	volatile bool td_expired;
+};
+
+void timedwait_start(struct timedwait *td, struct wchan *wc,
+		     struct spinlock *lk, unsigned ticks);
+bool timedwait_finish(struct timedwait *td);
+
+void timer_bootstrap(void);
+void timer_sleep(unsigned ticks);
+
+
+#endif /* _TIMER_H_ */
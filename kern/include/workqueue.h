@@ -0,0 +1,73 @@
+#ifndef _WORKQUEUE_H_
+#define _WORKQUEUE_H_
+
+/*
+ * Deferred work.
+ *
+ * A work item is a function to call later, in thread context, from a
+ * per-cpu kernel worker thread. Interrupt handlers use this to push
+ * anything heavier than waking somebody up out of interrupt context;
+ * other code can use it to get cleanup off a critical path.
+ *
+ * Each cpu has a queue and a worker thread bound to that cpu. Items
+ * are queued on the cpu that enqueues them. The worker takes
+ * everything queued at once and runs it as a batch, and is only woken
+ * when its queue goes from empty to nonempty, so a burst of items
+ * costs one wakeup.
+ *
+ * Work functions run with no locks held and may sleep. While one is
+ * running, its work item may be enqueued again (including by itself).
+ */
+
+#include <spinlock.h>
+#include <timer.h>
+
+struct wchan;		/* in <wchan.h> */
+
+struct work {
+	struct work *wk_next;		/* next in queue */
+	void (*wk_func)(void *);	/* function to call */
+	void *wk_data;			/* argument for it */
+	struct workqueue *wk_queue;	/* queue we were last put on */
+	volatile spinlock_data_t wk_pending; /* queued or timer armed */
+	struct timer wk_timer;		/* for delayed work */
+};
+
+struct workqueue {
+	struct spinlock wq_lock;
+	struct work *wq_head;		/* queued items, oldest first */
+	struct work **wq_tailp;		/* where to link the next one */
+	struct wchan *wq_wchan;		/* worker sleeps here */
+	unsigned wq_batches;		/* batches run */
+	unsigned wq_items;		/* items run */
+};
+
+/* Per-cpu queue setup, from cpu_create. */
+void workqueue_init(struct workqueue *wq);
+
+/* Start the worker threads; call once all cpus are up. */
+void workqueue_bootstrap(void);
+
+/*
+ * Work item functions.
+ *
+ * work_init               - set up a work item that will call FUNC(DATA).
+ * workqueue_enqueue       - queue it on the current cpu. Returns false
+ *                           (and does nothing) if it was already
+ *                           pending, that is, queued and not yet
+ *                           started, or waiting on its delay. Safe to
+ *                           call from interrupt handlers.
+ * workqueue_enqueue_delayed - same, but queue it only after TICKS
+ *                           hardclocks.
+ * workqueue_cancel        - take the item back if it is still pending.
+ *                           Returns true if it was; then it won't run.
+ *                           If it returns false the item may have
+ *                           already run, or may be about to.
+ */
+void work_init(struct work *wk, void (*func)(void *), void *data);
+bool workqueue_enqueue(struct work *wk);
+bool workqueue_enqueue_delayed(struct work *wk, unsigned ticks);
+bool workqueue_cancel(struct work *wk);
+
+
+#endif /* _WORKQUEUE_H_ */
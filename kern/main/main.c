@@ -38,6 +38,9 @@
 #include <lib.h>
 #include <spl.h>
 #include <clock.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <rcu.h>
 #include <thread.h>
 #include <proc.h>
 #include <current.h>
@@ -47,8 +50,10 @@
 #include <vfs.h>
 #include <device.h>
 #include <syscall.h>
+#include <futex_syscalls.h>
 #include <test.h>
 #include <version.h>
+#include <lockstat.h>
 #include "autoconf.h"  // for pseudoconfig
 
 
@@ -111,6 +116,9 @@ boot(void)
 	proc_bootstrap();
 	thread_bootstrap();
 	hardclock_bootstrap();
+	timer_bootstrap();
+	futex_bootstrap();
+	rcu_bootstrap();
 	vfs_bootstrap();
 	kheap_nextgeneration();
 
@@ -122,11 +130,17 @@ boot(void)
 	/* Now do pseudo-devices. */
 	pseudoconfig();
 	kprintf("\n");
+	/* The clock is attached now, so we can timestamp scheduling. */
+	thread_schedstats_start();
+#if OPT_LOCKSTAT
+	lockstat_start();
+#endif
 	kheap_nextgeneration();
 
 	/* Late phase of initialization. */
 	kprintf_bootstrap();
 	thread_start_cpus();
+	workqueue_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
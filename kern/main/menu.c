@@ -45,6 +45,8 @@
 #include <synch.h>
 #include <proc_syscalls.h>
 #include <kern/wait.h>
+#include <lockstat.h>
+#include <counter.h>
 #include "opt-synchprobs.h"
 #include "opt-sfs.h"
 #include "opt-net.h"
@@ -95,7 +97,8 @@ cmd_progthread(void *ptr, unsigned long nargs)
 	if (result) {
 		kprintf("Running program %s failed: %s\n", args[0],
 			strerror(result));
-		return;
+		/* Exit the way a program would, so common_prog's wait ends. */
+		_exit(_MKWAIT_EXIT(1));
 	}
 
 	/* NOTREACHED: runprogram only returns on error. */
@@ -118,7 +121,8 @@ int
 common_prog(int nargs, char **args)
 {
 	struct proc *proc;
-	int result;
+	pid_t pid;
+	int result, status;
 
 #if OPT_SYNCHPROBS
 	kprintf("Warning: this probably won't work with a "
@@ -140,17 +144,16 @@ common_prog(int nargs, char **args)
 		proc_destroy(proc);
 		return result;
 	}
-	
-	/* proc has no proper parent pid so we can't use waitpid to block instead 
-	 * we just use the exitLock on proc to block the menu thread until it exits
-	 */
-	struct semaphore *exitLock = get_exitLock(proc->pid);
-    P(exitLock);
 
 	/*
-	 * The new process will be destroyed when the program exits...
-	 * once you write the code for handling that.
+	 * The kernel process is its parent, so we can wait for it like
+	 * any other; this reaps it too.
 	 */
+	result = proc_waitchild(proc->pid, 0, &pid, &status);
+	if (result) {
+		kprintf("waitpid failed: %s\n", strerror(result));
+		return result;
+	}
 
 	return 0;
 }
@@ -418,6 +421,104 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+static
+int
+cmd_kheapprofile(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	kheap_profile();
+
+	return 0;
+}
+
+/*
+ * Command for printing scheduler statistics.
+ */
+static
+int
+cmd_schedstat(int nargs, char **args)
+{
+	char *report;
+	size_t len;
+
+	(void)nargs;
+	(void)args;
+
+	report = thread_schedstats(&len);
+	if (report == NULL) {
+		return ENOMEM;
+	}
+	kprintf("%s", report);
+	kfree(report);
+
+	return 0;
+}
+
+/*
+ * Command for turning tickless idle on and off, and for showing how
+ * many hardclocks it saved.
+ */
+static
+int
+cmd_tickless(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "on")) {
+		hardclock_tickless = true;
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		hardclock_tickless = false;
+	}
+	else if (nargs != 1) {
+		kprintf("Usage: tickless [on|off]\n");
+		return EINVAL;
+	}
+
+	kprintf("Tickless idle is %s\n", hardclock_tickless ? "on" : "off");
+	thread_cpustats();
+
+	return 0;
+}
+
+/*
+ * Command for printing the per-cpu event counters.
+ */
+static
+int
+cmd_counters(int nargs, char **args)
+{
+	(void)nargs;
+	(void)args;
+
+	counter_printall();
+
+	return 0;
+}
+
+#if OPT_LOCKSTAT
+/*
+ * Command for printing lock contention statistics, or clearing them.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 2 && !strcmp(args[1], "reset")) {
+		lockstat_reset();
+	}
+	else if (nargs == 1) {
+		lockstat_print();
+	}
+	else {
+		kprintf("Usage: lockstat [reset]\n");
+		return EINVAL;
+	}
+
+	return 0;
+}
+#endif
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -491,6 +592,13 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
+	"[sy5] Lock contention benchmark     ",
+	"[sy6] Rwlock test                   ",
+	"[sy7] FIFO semaphore test           ",
+	"[sl1] Spinlock stress test          ",
+	"[tm1] Timer test                    ",
+	"[wq1] Workqueue test                ",
+	"[rc1] RCU test                      ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -524,6 +632,13 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+	"[khprof] Kernel heap usage by site  ",
+	"[tickless] Tickless idle [on|off]   ",
+	"[schedstat] Scheduler statistics    ",
+	"[cnt] Event counters                ",
+#if OPT_LOCKSTAT
+	"[lockstat] Lock stats [reset]       ",
+#endif
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -578,6 +693,13 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+	{ "khprof",     cmd_kheapprofile },
+	{ "tickless",   cmd_tickless },
+	{ "schedstat",  cmd_schedstat },
+	{ "cnt",        cmd_counters },
+#if OPT_LOCKSTAT
+	{ "lockstat",   cmd_lockstat },
+#endif
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -599,6 +721,13 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	lockbench },
+	{ "sy6",	rwtest },
+	{ "sy7",	semtest2 },
+	{ "sl1",	spinlocktest },
+	{ "tm1",	timertest },
+	{ "wq1",	wqtest },
+	{ "rc1",	rcutest },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
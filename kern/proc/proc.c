@@ -44,6 +44,7 @@
 
 #include <types.h>
 #include <spl.h>
+#include <cpu.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
@@ -53,86 +54,181 @@
 #include <synch.h>
 #include <limits.h>
 #include <kern/errno.h>
+#include <kern/wait.h>
 #include <pid.h>
+#include <rcu.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
  */
 struct proc *kproc;
 
+/*
+ * The process tree: each process's parent, children and zombies, and
+ * its exit status. There is no lock for the tree as a whole; each
+ * process's p_familylock covers its own p_children, p_zombies and
+ * p_childcv, and the sibling links, p_exited and p_exitstatus of each
+ * of its children. A child's p_parent is only changed holding both the
+ * child's lock and the parent's, except that once the child is a
+ * zombie only its parent looks at it, and the parent's is enough.
+ * Nothing is done under any of these but moving list entries around,
+ * so unrelated parents and their children never wait for each other.
+ *
+ * The lock order is child, then parent. An exiting process takes its
+ * own lock and looks at p_parent; the parent can't go away while we
+ * hold that, because it has to take our lock to disown us before it
+ * can exit. Then it takes the parent's lock and moves itself to the
+ * parent's p_zombies, or, if the parent has gone, destroys itself. An
+ * exiting parent destroys its zombies and disowns its running
+ * children, letting go of its own lock to take each child's first.
+ */
+
 /*
  * Global variables
+ *
+ * pid_table_lock only serializes changes to the table; readers don't
+ * take it. There are two: get_pid_in_table, which just checks a slot
+ * for NULL, and proc_getchild, which follows the entry to its process
+ * under rcu_read_lock. New entries are published with rcu_assign, so
+ * readers see them filled in. An entry taken out of the table is freed
+ * through rcu_defer (see rcu.h), and so is the process it points to,
+ * so a reader can look at both until it leaves its read-side section.
  */
 struct pid *pid_table[PID_MAX];
 struct lock *pid_table_lock;
 
+/*
+ * Free pid allocator.
+ *
+ * pid_freemap has a bit set for each free pid, and pid_freesum has a
+ * bit set for each word of pid_freemap with any bit set. Allocation
+ * takes the first free pid at or after pid_hint, wrapping around, and
+ * moves the hint past it; so pids are handed out in rotation and one
+ * that was just freed isn't reused until the others have had a turn.
+ * Finding the next free pid looks at no more than two words of the
+ * map and one pass over the summary, however full the table is.
+ *
+ * All of this is protected by pid_table_lock.
+ */
+#define PID_WORDS	((PID_MAX + 31) / 32)
+#define PID_SUMWORDS	((PID_WORDS + 31) / 32)
+
+static uint32_t pid_freemap[PID_WORDS];
+static uint32_t pid_freesum[PID_SUMWORDS];
+static pid_t pid_hint = PID_MIN;
 
 /*
- * pid entry is destoryed and the slot can be reused after
+ * index of the lowest set bit in a nonzero word
  */
-void
-destroy_pid_entry(pid_t pidIndex)
+static
+unsigned
+pid_lowbit(uint32_t word)
 {
-	lock_acquire(pid_table_lock);
-
-	if (pid_table[pidIndex] != NULL){
-		sem_destroy(pid_table[pidIndex]->exitLock);
-		kfree(pid_table[pidIndex]);
-		pid_table[pidIndex] = NULL;
-	}
-	lock_release(pid_table_lock);
+	unsigned bit = 0;
+
+	KASSERT(word != 0);
+	if ((word & 0xffff) == 0) { word >>= 16; bit += 16; }
+	if ((word & 0xff) == 0) { word >>= 8; bit += 8; }
+	if ((word & 0xf) == 0) { word >>= 4; bit += 4; }
+	if ((word & 0x3) == 0) { word >>= 2; bit += 2; }
+	if ((word & 0x1) == 0) { bit += 1; }
+	return bit;
 }
 
 /*
- * update exitFlag in pid entry at pidIndex
+ * mark pid free
  */
+static
 void
-set_pid_exitFlag(pid_t pidIndex, bool exitFlag)
+pid_release(pid_t pid)
 {
-	lock_acquire(pid_table_lock);
-	pid_table[pidIndex]->exitFlag = exitFlag;
-	lock_release(pid_table_lock);
+	unsigned word = pid / 32;
+
+	pid_freemap[word] |= 1U << (pid % 32);
+	pid_freesum[word / 32] |= 1U << (word % 32);
 }
 
 /*
- * gets exitFlag in pid entry at pidIndex
+ * take the next free pid in rotation; returns 0 if there are none
  */
-bool
-get_pid_exitFlag(pid_t pidIndex)
+static
+pid_t
+pid_alloc(void)
 {
-	lock_acquire(pid_table_lock);
-	KASSERT(pid_table[pidIndex] != NULL);
+	unsigned word, next, sumword, i;
+	uint32_t bits;
+	pid_t pid;
+
+	KASSERT(lock_do_i_hold(pid_table_lock));
+
+	// the hint's own word, from the hint up
+	word = pid_hint / 32;
+	bits = pid_freemap[word] & (~0U << (pid_hint % 32));
+
+	// otherwise the next word with anything free, going round once
+	// (the last step looks at the first summary word again, whole,
+	// for words before the hint's)
+	if (bits == 0) {
+		next = (word + 1) % PID_WORDS;
+		for (i = 0; i <= PID_SUMWORDS; i++) {
+			sumword = (next / 32 + i) % PID_SUMWORDS;
+			bits = pid_freesum[sumword];
+			if (i == 0) {
+				bits &= ~0U << (next % 32);
+			}
+			if (bits != 0) {
+				break;
+			}
+		}
+		if (bits == 0) {
+			return 0;
+		}
+		word = sumword * 32 + pid_lowbit(bits);
+		bits = pid_freemap[word];
+	}
 
-	bool ret = pid_table[pidIndex]->exitFlag;
-	lock_release(pid_table_lock);
+	pid = word * 32 + pid_lowbit(bits);
+	KASSERT(pid >= PID_MIN && pid < PID_MAX);
 
-	return ret;
+	pid_freemap[word] &= ~(1U << (pid % 32));
+	if (pid_freemap[word] == 0) {
+		pid_freesum[word / 32] &= ~(1U << (word % 32));
+	}
+	pid_hint = pid + 1 < PID_MAX ? pid + 1 : PID_MIN;
+	return pid;
 }
 
+
 /*
- * update exitStatus in pid entry at pidIndex
+ * free a pid entry and its process once readers are done with them;
+ * called from rcu
  */
+static
 void
-set_pid_exitStatus(pid_t pidIndex, int exitStatus)
+free_pid_entry(void *data)
 {
-	lock_acquire(pid_table_lock);
-	pid_table[pidIndex]->exitStatus = exitStatus;
-	lock_release(pid_table_lock);
+	struct pid *entry = data;
+
+	kfree(entry->proc);
+	kfree(entry);
 }
 
 /*
- * get exitStatus in pid entry at pidIndex
+ * pid entry is destoryed and the slot can be reused after; this is the
+ * last thing proc_destroy does, and the process structure itself goes
+ * with the entry
  */
-int
-get_pid_exitStatus(pid_t pidIndex)
+void
+destroy_pid_entry(pid_t pidIndex)
 {
 	lock_acquire(pid_table_lock);
-	KASSERT(pid_table[pidIndex] != NULL);
-
-	int ret = pid_table[pidIndex]->exitStatus;
+	struct pid *entry = pid_table[pidIndex];
+	KASSERT(entry != NULL);
+	pid_table[pidIndex] = NULL;
+	pid_release(pidIndex);
 	lock_release(pid_table_lock);
 
-	return ret;
+	rcu_defer(&entry->rcu, free_pid_entry, entry);
 }
 
 /*
@@ -145,44 +241,45 @@ get_pid_in_table(pid_t pidIndex)
 		return false;
 	}
 
-	lock_acquire(pid_table_lock);
-	bool ret = pid_table[pidIndex] != NULL;
-	lock_release(pid_table_lock);
-
-	return ret;
+	// a single aligned load; nothing to protect
+	return pid_table[pidIndex] != NULL;
 }
 
 /*
- * get parentPid in pid entry at pidIndex
+ * Process lists.
  */
-pid_t
-get_parent_pid(pid_t pidIndex)
+static
+void
+proclist_init(struct proclist *pl)
 {
-	lock_acquire(pid_table_lock);
-	KASSERT(pid_table[pidIndex] != NULL);
-
-	pid_t ret = pid_table[pidIndex]->parentPid;
-	lock_release(pid_table_lock);
-
-	return ret;
+	pl->pl_head = NULL;
+	pl->pl_tailp = &pl->pl_head;
 }
 
-/*
- * get exitLock in pid entry at pidIndex
- */
-struct semaphore*
-get_exitLock(pid_t pidIndex)
+static
+void
+proclist_addtail(struct proclist *pl, struct proc *p)
 {
-	lock_acquire(pid_table_lock);
-	KASSERT(pid_table[pidIndex] != NULL);
-
-	struct semaphore* ret = pid_table[pidIndex]->exitLock;
-	lock_release(pid_table_lock);
-
-	return ret;
+	p->p_sibnext = NULL;
+	p->p_sibprevp = pl->pl_tailp;
+	*pl->pl_tailp = p;
+	pl->pl_tailp = &p->p_sibnext;
 }
 
-
+static
+void
+proclist_remove(struct proclist *pl, struct proc *p)
+{
+	*p->p_sibprevp = p->p_sibnext;
+	if (p->p_sibnext != NULL) {
+		p->p_sibnext->p_sibprevp = p->p_sibprevp;
+	}
+	else {
+		pl->pl_tailp = p->p_sibprevp;
+	}
+	p->p_sibnext = NULL;
+	p->p_sibprevp = NULL;
+}
 
 /*
  * Create a proc structure.
@@ -212,14 +309,43 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+	/* Scheduling fields */
+	proc->p_cpumask = CPUMASK_ALL;
+
+	/* User threads; the lock and friends are made on first use */
+	proc->p_uthreadlock = NULL;
+	proc->p_uthreadcv = NULL;
+	proc->p_uthreads = NULL;
+	proc->p_nexttid = 1;
+	proc->p_nlive = 1;
+	proc->p_nattached = 1;
+	proc->p_exiting = false;
+
+	/* Process fields; filled in by proc_create_runprogram */
+	proc->oft = NULL;
+	proc->pid = 0;
+
+	/* Process tree */
+	proc->p_parent = NULL;
+	proc->p_sibnext = NULL;
+	proc->p_sibprevp = NULL;
+	proclist_init(&proc->p_children);
+	proclist_init(&proc->p_zombies);
+	proc->p_familylock = NULL;
+	proc->p_childcv = NULL;
+	proc->p_exited = false;
+	proc->p_exitstatus = 0;
+	proc->p_vforkdone = NULL;
+
 	return proc;
 }
 
 /*
  * Destroy a proc structure.
  *
- * Note: nothing currently calls this. Your wait/exit code will
- * probably want to do so.
+ * This is called by whoever reaps the process (or by the process
+ * itself on its way out, if it has no parent), after its last thread
+ * has detached; and to clean up after a failed fork.
  */
 void
 proc_destroy(struct proc *proc)
@@ -235,6 +361,23 @@ proc_destroy(struct proc *proc)
 	KASSERT(proc != NULL);
 	KASSERT(proc != kproc);
 
+	/*
+	 * Leave the process tree. Only a failed fork still has a parent
+	 * here, and that's us; it never ran, so its own lock isn't needed.
+	 */
+	if (proc->p_parent != NULL) {
+		struct proc *parent = proc->p_parent;
+
+		KASSERT(parent == curproc);
+		KASSERT(!proc->p_exited);
+		lock_acquire(parent->p_familylock);
+		proclist_remove(&parent->p_children, proc);
+		proc->p_parent = NULL;
+		lock_release(parent->p_familylock);
+	}
+	KASSERT(proc->p_children.pl_head == NULL);
+	KASSERT(proc->p_zombies.pl_head == NULL);
+
 	/*
 	 * We don't take p_lock in here because we must have the only
 	 * reference to this structure. (Otherwise it would be
@@ -247,7 +390,8 @@ proc_destroy(struct proc *proc)
 		proc->p_cwd = NULL;
 	}
 
-	/* VM fields */
+	/* VM fields; never one borrowed by vfork */
+	KASSERT(proc->p_vforkdone == NULL);
 	if (proc->p_addrspace) {
 		/*
 		 * If p is the current process, remove it safely from
@@ -302,17 +446,38 @@ proc_destroy(struct proc *proc)
 
 	open_file_table_destroy(proc->oft);
 
-	// clean up pid entry, childProcs array and childProcsLock
-	if (proc->pid) {
-    	destroy_pid_entry(proc->pid);
+	if (proc->p_childcv) {
+		cv_destroy(proc->p_childcv);
+	}
+	if (proc->p_familylock) {
+		lock_destroy(proc->p_familylock);
 	}
 
-	if (proc->childProcs) {
-    	array_destroy(proc->childProcs);
+	// clean up user thread records nobody joined
+	if (proc->p_uthreads) {
+		while (array_num(proc->p_uthreads) > 0) {
+			kfree(array_get(proc->p_uthreads, 0));
+			array_remove(proc->p_uthreads, 0);
+		}
+		array_destroy(proc->p_uthreads);
+	}
+	if (proc->p_uthreadcv) {
+		cv_destroy(proc->p_uthreadcv);
+	}
+	if (proc->p_uthreadlock) {
+		lock_destroy(proc->p_uthreadlock);
 	}
 
-	if (proc->childProcsLock) {
-    	lock_destroy(proc->childProcsLock);
+	/*
+	 * Give up the pid. proc_getchild may have found us through the
+	 * pid table and be looking at p_parent, so the structure itself
+	 * is freed along with the entry, once it's done.
+	 */
+	if (proc->pid) {
+		destroy_pid_entry(proc->pid);
+	}
+	else {
+		kfree(proc);
 	}
 }
 
@@ -331,6 +496,19 @@ proc_bootstrap(void)
 	if (pid_table_lock == NULL) {
 		panic("failed to create pid table lock\n");
 	}
+	for (pid_t pid = PID_MIN; pid < PID_MAX; pid++) {
+		pid_release(pid);
+	}
+
+	// the menu's programs are our children
+	kproc->p_familylock = lock_create("proc family");
+	if (kproc->p_familylock == NULL) {
+		panic("failed to create kproc family lock\n");
+	}
+	kproc->p_childcv = cv_create("kproc children");
+	if (kproc->p_childcv == NULL) {
+		panic("failed to create kproc child cv\n");
+	}
 
 	kproc->pid = 1;
 }
@@ -367,6 +545,8 @@ proc_create_runprogram(const char *name)
 		VOP_INCREF(curproc->p_cwd);
 		newproc->p_cwd = curproc->p_cwd;
 	}
+	/* Scheduling fields: inherit our affinity, as for the cwd */
+	newproc->p_cpumask = curproc->p_cpumask;
 	spinlock_release(&curproc->p_lock);
 
 	/*
@@ -381,35 +561,261 @@ proc_create_runprogram(const char *name)
 	}
 	result = special_fd_create(newproc->oft);
 	if (result) {
+		proc_destroy(newproc);
+		return NULL;
+	}
+
+	newproc->p_familylock = lock_create("proc family");
+	if (newproc->p_familylock == NULL) {
+		proc_destroy(newproc);
+		return NULL;
+	}
+	newproc->p_childcv = cv_create(name);
+	if (newproc->p_childcv == NULL) {
+		proc_destroy(newproc);
+		return NULL;
+	}
+
+	// create pid entry for the new process, then grab lock and give it
+	// a pid
+	struct pid *entry = kmalloc(sizeof(struct pid));
+	if (entry == NULL) {
+		proc_destroy(newproc);
 		return NULL;
 	}
+	entry->proc = newproc;
 
-	// grab lock and create pid entry for the new process
 	lock_acquire(pid_table_lock);
-	for (int i = PID_MIN; i < PID_MAX + 1; i++) {
-		if (pid_table[i] == NULL) { // found empty slot in pid table
-			pid_table[i] = kmalloc(sizeof(struct pid));
-			if (pid_table[i] == NULL) {
-				return 0;
-			}
-			pid_table[i]->exitFlag = false;
-			pid_table[i]->exitLock = sem_create("exitLock", 0);
-			pid_table[i]->parentPid = curproc->pid;
+	pid_t pid = pid_alloc();
+	if (pid == 0) { // too many processes in pid table
+		lock_release(pid_table_lock);
+		kfree(entry);
+		proc_destroy(newproc);
+		return NULL;
+	}
+	// readers don't lock; fill it in before they can see it
+	rcu_assign(pid_table[pid], entry);
+	newproc->pid = pid;
+	lock_release(pid_table_lock);
+
+	// we're its parent; nobody else knows about it yet, so only our
+	// lock is needed
+	lock_acquire(curproc->p_familylock);
+	newproc->p_parent = curproc;
+	proclist_addtail(&curproc->p_children, newproc);
+	lock_release(curproc->p_familylock);
 
-			newproc->pid = i;
+	return newproc;
+}
+
+/*
+ * Disown PROC's children as it exits. Zombies have nobody else to
+ * reap them, so go now; running children will see they have no parent
+ * when they exit, and destroy themselves.
+ *
+ * A running child's lock comes before ours, so to disown one we have
+ * to let go of ours and take both again. It can't go anywhere
+ * meanwhile: while it has a parent, it doesn't destroy itself. It may
+ * exit and become a zombie, though, so check again which list it's on.
+ * Nobody adds to either list now; we're the last thread.
+ */
+void
+proc_orphanchildren(struct proc *proc)
+{
+	struct proc *child, *zombies;
+
+	lock_acquire(proc->p_familylock);
+	while ((child = proc->p_children.pl_head) != NULL) {
+		lock_release(proc->p_familylock);
+		lock_acquire(child->p_familylock);
+		lock_acquire(proc->p_familylock);
+		KASSERT(child->p_parent == proc);
+		if (child->p_exited) {
+			// picked up with the rest below
+			lock_release(child->p_familylock);
+			continue;
+		}
+		proclist_remove(&proc->p_children, child);
+		child->p_parent = NULL;
+		lock_release(child->p_familylock);
+	}
+
+	zombies = proc->p_zombies.pl_head;
+	for (child = zombies; child != NULL; child = child->p_sibnext) {
+		child->p_parent = NULL;
+	}
+	proclist_init(&proc->p_zombies);
+	lock_release(proc->p_familylock);
+
+	// nobody else can find these any more
+	while (zombies != NULL) {
+		child = zombies;
+		zombies = child->p_sibnext;
+		proc_destroy(child);
+	}
+}
+
+/*
+ * Hand an exited process to its parent. Once it's on the zombie list
+ * the parent may destroy it at any moment, so the caller mustn't touch
+ * it again if this returns true; that's also why our own lock is let go
+ * before the parent's.
+ */
+bool
+proc_zombify(struct proc *proc, int status)
+{
+	struct proc *parent;
+
+	KASSERT(threadarray_num(&proc->p_threads) == 0);
+
+	lock_acquire(proc->p_familylock);
+	parent = proc->p_parent;
+	if (parent == NULL) {
+		lock_release(proc->p_familylock);
+		return false;
+	}
+	lock_acquire(parent->p_familylock);
+	proc->p_exitstatus = status;
+	proc->p_exited = true;
+	proclist_remove(&parent->p_children, proc);
+	proclist_addtail(&parent->p_zombies, proc);
+	// the parent may have several threads waiting for different pids
+	cv_broadcast(parent->p_childcv, parent->p_familylock);
+	lock_release(proc->p_familylock);
+	lock_release(parent->p_familylock);
+
+	return true;
+}
+
+/*
+ * Find a child of the current process by pid. The caller must hold
+ * our p_familylock; then none of our children can be destroyed, and
+ * nothing else's p_parent can change to us. The entry, and the process
+ * it points to, may be on their way out if it's someone else's, but
+ * they aren't freed until we leave the read-side section.
+ */
+struct proc *
+proc_getchild(pid_t pid)
+{
+	struct pid *entry;
+	struct proc *child;
+	int spl;
+
+	KASSERT(lock_do_i_hold(curproc->p_familylock));
+
+	if (pid < PID_MIN || pid >= PID_MAX) {
+		return NULL;
+	}
+	child = NULL;
+	spl = rcu_read_lock();
+	entry = pid_table[pid];
+	if (entry != NULL && entry->proc->p_parent == curproc) {
+		child = entry->proc;
+	}
+	rcu_read_unlock(spl);
+	return child;
+}
+
+/*
+ * Reap a child of the current process. Any-child waits take the oldest
+ * zombie off the front of the list, and waits for a given pid find it
+ * through the pid table, so neither looks at the other children.
+ */
+int
+proc_waitchild(pid_t pid, int options, pid_t *retpid, int *status)
+{
+	struct proc *proc = curproc;
+	struct proc *child;
+	int result;
+
+	if ((options & ~WNOHANG) != 0) {
+		return EINVAL;
+	}
+	if (pid != WAIT_ANY && pid <= 0) {
+		// no process groups
+		return EINVAL;
+	}
+
+	lock_acquire(proc->p_familylock);
+	while (1) {
+		result = 0;
+		if (pid == WAIT_ANY) {
+			child = proc->p_zombies.pl_head;
+			if (child == NULL && proc->p_children.pl_head == NULL) {
+				result = ECHILD;
+			}
+		}
+		else {
+			// look it up again each time round; another of
+			// our threads may have reaped it meanwhile
+			child = proc_getchild(pid);
+			if (child == NULL) {
+				result = get_pid_in_table(pid) ? ECHILD : ESRCH;
+			}
+			else if (!child->p_exited) {
+				child = NULL;
+			}
+		}
+		if (result || child != NULL || (options & WNOHANG)) {
 			break;
-		} else if (i == PID_MAX) { // too many processes in pid table
-			lock_release(pid_table_lock);
-			return NULL;
 		}
+		cv_wait(proc->p_childcv, proc->p_familylock);
 	}
-	lock_release(pid_table_lock);
+	if (child != NULL) {
+		proclist_remove(&proc->p_zombies, child);
+		child->p_parent = NULL;
+	}
+	lock_release(proc->p_familylock);
 
-	newproc->parentDead = false;
-	newproc->childProcs = array_create();
-	newproc->childProcsLock = lock_create("childProcsLock");
+	if (result) {
+		return result;
+	}
+	if (child == NULL) {
+		*retpid = 0;
+		return 0;
+	}
 
-	return newproc;
+	*retpid = child->pid;
+	*status = child->p_exitstatus;
+	proc_destroy(child);
+	return 0;
+}
+
+/*
+ * vfork handoff. The flag lives on the parent's stack; the parent can't
+ * go anywhere until it's set, so the child can always find the parent
+ * and its cv.
+ */
+void
+proc_vforkwait(bool *done)
+{
+	struct proc *proc = curproc;
+
+	lock_acquire(proc->p_familylock);
+	while (!*done) {
+		cv_wait(proc->p_childcv, proc->p_familylock);
+	}
+	lock_release(proc->p_familylock);
+}
+
+void
+proc_vforkdone(struct proc *proc)
+{
+	struct proc *parent;
+
+	// only we look at p_vforkdone, and the parent can't disown us
+	// while it's waiting
+	if (proc->p_vforkdone == NULL) {
+		return;
+	}
+	parent = proc->p_parent;
+	KASSERT(parent != NULL);
+
+	lock_acquire(parent->p_familylock);
+	*proc->p_vforkdone = true;
+	proc->p_vforkdone = NULL;
+	cv_broadcast(parent->p_childcv, parent->p_familylock);
+	lock_release(parent->p_familylock);
 }
 
 /*
@@ -478,6 +884,36 @@ proc_remthread(struct thread *t)
 	panic("Thread (%p) has escaped from its process (%p)\n", t, proc);
 }
 
+/*
+ * Set the affinity of a process and all its threads. Holding p_lock
+ * keeps the thread list still; thread_fork reads the process's mask
+ * under p_lock after attaching the new thread, so it can't miss this.
+ * The scheduler reads t_cpumask without locking; a stale value just
+ * means a thread takes a little longer to move.
+ */
+int
+proc_setaffinity(struct proc *proc, unsigned mask)
+{
+	unsigned i, numcpus;
+
+	numcpus = cpu_count();
+	if (numcpus < 32) {
+		mask &= (1U << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	spinlock_acquire(&proc->p_lock);
+	proc->p_cpumask = mask;
+	for (i=0; i<threadarray_num(&proc->p_threads); i++) {
+		threadarray_get(&proc->p_threads, i)->t_cpumask = mask;
+	}
+	spinlock_release(&proc->p_lock);
+
+	return 0;
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
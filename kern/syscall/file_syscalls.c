@@ -74,18 +74,18 @@ open(const_userptr_t filename, int flags, mode_t mode, int *retval)
     }
 
     /* find the first empty entry in the open file table */
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_write(curproc->oft->table_lock);
     for (int i = 0; i < OPEN_MAX; i++) {
         if (curproc->oft->table[i] == NULL) {
             curproc->oft->table[i] = of;
             kfree(kern_filename);
             kfree(path_len);
-            lock_release(curproc->oft->table_lock);
+            rwlock_release_write(curproc->oft->table_lock);
             *retval = i;
             return 0;
         }
     }
-    lock_release(curproc->oft->table_lock);
+    rwlock_release_write(curproc->oft->table_lock);
 
     open_file_destroy(of);
     kfree(kern_filename);
@@ -110,9 +110,9 @@ close(int fd)
         return EBADF;
     }
 
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_write(curproc->oft->table_lock);
     if (curproc->oft->table[fd] == NULL) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_write(curproc->oft->table_lock);
         return EBADF;
     }
     /* 
@@ -121,7 +121,7 @@ close(int fd)
      */
     open_file_decref(curproc->oft->table[fd]);
     curproc->oft->table[fd] = NULL;
-    lock_release(curproc->oft->table_lock);
+    rwlock_release_write(curproc->oft->table_lock);
 
     return 0;
 }
@@ -146,9 +146,9 @@ read(int fd, userptr_t buf, size_t buflen, int *retval)
     
     struct open_file *of;
 
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_read(curproc->oft->table_lock);
     if (curproc->oft->table[fd] == NULL) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_read(curproc->oft->table_lock);
         return EBADF;
     } else {
         of = curproc->oft->table[fd];
@@ -156,27 +156,35 @@ read(int fd, userptr_t buf, size_t buflen, int *retval)
 
     /* check if file permissions are not write only */
     if ((of->flag & O_WRONLY) != 0) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_read(curproc->oft->table_lock);
         return EBADF;
     }
-    lock_release(curproc->oft->table_lock);
+    /* 
+     * hold a reference while we use it, so another thread's close or
+     * dup2 on this fd can't free it out from under us
+     */
+    open_file_incref(of);
+    rwlock_release_read(curproc->oft->table_lock);
     
+    /* uio state lives on the stack so the I/O path never hits kmalloc */
     int result;
-    struct iovec *iov = kmalloc(sizeof(struct iovec));
-    struct uio *myuio = kmalloc(sizeof(struct uio));
-    
+    struct iovec iov;
+    struct uio myuio;
+
     lock_acquire(of->flock);
-    uio_uinit(iov, myuio, buf, buflen, of->offset, UIO_READ);
+    uio_uinit(&iov, &myuio, buf, buflen, of->offset, UIO_READ);
 
-    result = VOP_READ(of->vn, myuio);
+    result = VOP_READ(of->vn, &myuio);
     if (result) {
         lock_release(of->flock);
+        open_file_decref(of);
         return result;
     }
 
-    *retval = myuio->uio_offset - of->offset;
-    of->offset = myuio->uio_offset;
+    *retval = myuio.uio_offset - of->offset;
+    of->offset = myuio.uio_offset;
     lock_release(of->flock);
+    open_file_decref(of);
 
     return 0;
 }
@@ -201,9 +209,9 @@ write(int fd, userptr_t buf, size_t nbytes, int *retval)
     
     struct open_file *of;
 
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_read(curproc->oft->table_lock);
     if (curproc->oft->table[fd] == NULL) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_read(curproc->oft->table_lock);
         return EBADF;
     } else {
         of = curproc->oft->table[fd];
@@ -211,27 +219,31 @@ write(int fd, userptr_t buf, size_t nbytes, int *retval)
     
     /* check if file has write permissions */
     if ((of->flag & O_RDWR) == 0 && (of->flag & O_WRONLY) == 0) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_read(curproc->oft->table_lock);
         return EBADF;
     }
-    lock_release(curproc->oft->table_lock);
+    /* as in read(), pin the entry and keep the uio on the stack */
+    open_file_incref(of);
+    rwlock_release_read(curproc->oft->table_lock);
 
     int result;
-    struct iovec *iov = kmalloc(sizeof(struct iovec));
-    struct uio *myuio = kmalloc(sizeof(struct uio));
+    struct iovec iov;
+    struct uio myuio;
 
     lock_acquire(of->flock);
-    uio_uinit(iov, myuio, buf, nbytes, of->offset, UIO_WRITE);
+    uio_uinit(&iov, &myuio, buf, nbytes, of->offset, UIO_WRITE);
 
-    result = VOP_WRITE(of->vn, myuio);
+    result = VOP_WRITE(of->vn, &myuio);
     if (result) {
         lock_release(of->flock);
+        open_file_decref(of);
         return result;
     }
     
-    *retval = myuio->uio_offset - of->offset;
-    of->offset = myuio->uio_offset;
+    *retval = myuio.uio_offset - of->offset;
+    of->offset = myuio.uio_offset;
     lock_release(of->flock);
+    open_file_decref(of);
 
     return 0;
 }
@@ -262,16 +274,19 @@ lseek(int fd, off_t pos, int whence, off_t *ret_pos)
 
     struct open_file *of;
 
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_read(curproc->oft->table_lock);
     if (curproc->oft->table[fd] == NULL) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_read(curproc->oft->table_lock);
         return EBADF;
     } else {
         of = curproc->oft->table[fd];
     }
-    lock_release(curproc->oft->table_lock);
+    /* as in read() */
+    open_file_incref(of);
+    rwlock_release_read(curproc->oft->table_lock);
 
     if (!VOP_ISSEEKABLE(of->vn)) {
+        open_file_decref(of);
 		return ESPIPE;
 	}
 
@@ -286,29 +301,31 @@ lseek(int fd, off_t pos, int whence, off_t *ret_pos)
             break;
 
         case SEEK_END: ;
-            struct stat *statbuf = kmalloc(sizeof(struct stat));
-            int result = VOP_STAT(of->vn, statbuf);
+            struct stat statbuf;
+            int result = VOP_STAT(of->vn, &statbuf);
             if (result) {
                 lock_release(of->flock);
-                kfree(statbuf);
+                open_file_decref(of);
                 return result;
             }
-            of->offset = statbuf->st_size + pos;
-            kfree(statbuf);
+            of->offset = statbuf.st_size + pos;
             break;
             
         default: 
             lock_release(of->flock);
+            open_file_decref(of);
             return EINVAL;
     }
 
     if (of->offset < 0) {
         lock_release(of->flock);
+        open_file_decref(of);
         return EINVAL;
     }
 
     *ret_pos = of->offset;
     lock_release(of->flock);
+    open_file_decref(of);
 
     return 0;
 }
@@ -321,9 +338,9 @@ dup2(int oldfd, int newfd, int *retval)
         return EBADF;
     }
 
-    lock_acquire(curproc->oft->table_lock);
+    rwlock_acquire_write(curproc->oft->table_lock);
     if (curproc->oft->table[oldfd] == NULL) {
-        lock_release(curproc->oft->table_lock);
+        rwlock_release_write(curproc->oft->table_lock);
         return EBADF;
     }
     if (curproc->oft->table[newfd] != NULL) {
@@ -331,7 +348,7 @@ dup2(int oldfd, int newfd, int *retval)
     }
     curproc->oft->table[newfd] = curproc->oft->table[oldfd];
     open_file_incref(curproc->oft->table[oldfd]);
-    lock_release(curproc->oft->table_lock);
+    rwlock_release_write(curproc->oft->table_lock);
 
     *retval = newfd;
     return 0;
@@ -380,13 +397,13 @@ int
 __getcwd(userptr_t buf, size_t buflen, int *retval)
 {
     int result;
-    struct iovec *iov = kmalloc(sizeof(struct iovec));
-    struct uio *myuio = kmalloc(sizeof(struct uio));
-    
-    uio_uinit(iov, myuio, buf, buflen, 0, UIO_READ);
+    struct iovec iov;
+    struct uio myuio;
+
+    uio_uinit(&iov, &myuio, buf, buflen, 0, UIO_READ);
 
-    result = vfs_getcwd(myuio);
+    result = vfs_getcwd(&myuio);
 
-    *retval = myuio->uio_offset;
+    *retval = myuio.uio_offset;
     return result;
 }
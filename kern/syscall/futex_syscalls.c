@@ -0,0 +1,282 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <proc.h>
+#include <timer.h>
+#include <copyinout.h>
+#include <thread_syscalls.h>
+#include <futex_syscalls.h>
+
+/*
+ * Futexes: sleeping and waking on a word of user memory.
+ *
+ * A user-level lock keeps its state in an int in the process's own
+ * memory and changes it with atomic instructions. It only calls into
+ * the kernel when it has to sleep (futex_wait) or has a sleeper to wake
+ * (futex_wake), so an uncontended lock never enters the kernel at all,
+ * and a contended one goes straight to a wait queue instead of through
+ * the VFS the way a semfs semaphore does.
+ *
+ * Waiters are keyed by process and user address. Processes don't share
+ * memory, so a futex is only seen by the threads of its own process.
+ * Keys hash into a fixed table of buckets, each with a spinlock, a wait
+ * channel, and a FIFO list of the waiters hashed there.
+ *
+ * futex_wait goes on its bucket's list *before* reading the user's
+ * word, and comes off again if the value has already changed. copyin
+ * can fault, so it can't be done under the bucket spinlock; doing it in
+ * this order means that a waker that changes the word and then calls
+ * futex_wake always finds us: either we read the new value, or we are
+ * on the list and get marked woken.
+ */
+
+#define FUTEX_NBUCKETS 64
+
+/*
+ * a sleeping thread; lives on its stack in futex_wait
+ */
+struct futex_waiter {
+    struct proc *fw_proc;           // key: process
+    vaddr_t fw_addr;                // key: user address
+    struct thread *fw_thread;       // who is waiting
+    bool fw_woken;                  // set by futex_wake, under fb_lock
+    struct futex_waiter *fw_next;   // next in bucket
+};
+
+struct futex_bucket {
+    struct spinlock fb_lock;
+    struct wchan *fb_wchan;
+    struct futex_waiter *fb_head;   // waiters, oldest first
+    struct futex_waiter **fb_tailp; // where to link the next one
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+/*
+ * Support functions.
+ */
+
+static
+struct futex_bucket *
+futex_hash(struct proc *proc, vaddr_t addr)
+{
+    unsigned h;
+
+    // the low bits of both are always zero
+    h = (addr >> 2) ^ ((uintptr_t) proc >> 4);
+    return &futex_table[h % FUTEX_NBUCKETS];
+}
+
+/*
+ * take the waiter at *FWP off its bucket's list; fb_lock must be held
+ */
+static
+void
+futex_remove(struct futex_bucket *fb, struct futex_waiter **fwp)
+{
+    struct futex_waiter *fw = *fwp;
+
+    KASSERT(spinlock_do_i_hold(&fb->fb_lock));
+
+    *fwp = fw->fw_next;
+    if (fb->fb_tailp == &fw->fw_next) {
+        fb->fb_tailp = fwp;
+    }
+}
+
+/*
+ * take FW off its bucket's list if it is still there
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+    struct futex_waiter **fwp;
+
+    for (fwp = &fb->fb_head; *fwp != NULL; fwp = &(*fwp)->fw_next) {
+        if (*fwp == fw) {
+            futex_remove(fb, fwp);
+            return;
+        }
+    }
+}
+
+/*
+ * take the waiter at *FWP off the list and wake it
+ */
+static
+void
+futex_wakeone(struct futex_bucket *fb, struct futex_waiter **fwp)
+{
+    struct futex_waiter *fw = *fwp;
+
+    futex_remove(fb, fwp);
+    fw->fw_woken = true;
+    // it may not have gone to sleep yet; then it sees fw_woken
+    wchan_wakethread(fb->fb_wchan, &fb->fb_lock, fw->fw_thread);
+}
+
+void
+futex_bootstrap(void)
+{
+    for (unsigned i = 0; i < FUTEX_NBUCKETS; i++) {
+        struct futex_bucket *fb = &futex_table[i];
+
+        spinlock_init(&fb->fb_lock);
+        fb->fb_wchan = wchan_create("futex");
+        if (fb->fb_wchan == NULL) {
+            panic("futex_bootstrap: Out of memory\n");
+        }
+        fb->fb_head = NULL;
+        fb->fb_tailp = &fb->fb_head;
+    }
+}
+
+/*
+ * Wake every thread of PROC that is waiting on a futex. Called with
+ * p_exiting set, so that threads blocked in futex_wait don't hold up
+ * _exit or execv; a thread that gets to futex_wait after this sees
+ * p_exiting and doesn't sleep.
+ */
+void
+futex_wakeproc(struct proc *proc)
+{
+    for (unsigned i = 0; i < FUTEX_NBUCKETS; i++) {
+        struct futex_bucket *fb = &futex_table[i];
+        struct futex_waiter **fwp;
+
+        spinlock_acquire(&fb->fb_lock);
+        fwp = &fb->fb_head;
+        while (*fwp != NULL) {
+            if ((*fwp)->fw_proc == proc) {
+                futex_wakeone(fb, fwp);
+            }
+            else {
+                fwp = &(*fwp)->fw_next;
+            }
+        }
+        spinlock_release(&fb->fb_lock);
+    }
+}
+
+/*
+ * wait on a futex
+ * ------------
+ *
+ * addr:        user address of an int
+ * val:         go to sleep only if *addr still holds this
+ * msecs:       give up after this long; 0 means wait indefinitely
+ *
+ * returns:     0 when woken (or spuriously), EAGAIN if *addr didn't
+ *              hold val, ETIMEDOUT if msecs went by first
+ */
+int
+futex_wait(userptr_t addr, int val, unsigned msecs)
+{
+    struct proc *proc = curproc;
+    struct futex_bucket *fb;
+    struct futex_waiter fw;
+    struct timedwait td;
+    bool woken, expired;
+    int cur, result;
+
+    if ((vaddr_t) addr % sizeof(int) != 0) {
+        return EINVAL;
+    }
+
+    fw.fw_proc = proc;
+    fw.fw_addr = (vaddr_t) addr;
+    fw.fw_thread = curthread;
+    fw.fw_woken = false;
+    fw.fw_next = NULL;
+    fb = futex_hash(proc, fw.fw_addr);
+
+    spinlock_acquire(&fb->fb_lock);
+    *fb->fb_tailp = &fw;
+    fb->fb_tailp = &fw.fw_next;
+    spinlock_release(&fb->fb_lock);
+
+    result = copyin(addr, &cur, sizeof(cur));
+    if (result == 0 && cur != val) {
+        result = EAGAIN;
+    }
+    if (result) {
+        spinlock_acquire(&fb->fb_lock);
+        woken = fw.fw_woken;
+        if (!woken) {
+            futex_unlink(fb, &fw);
+        }
+        spinlock_release(&fb->fb_lock);
+        // a wakeup that already picked us must not be lost
+        return woken ? 0 : result;
+    }
+
+    // as in cv_timedwait, arm the timer before taking the spinlock
+    if (msecs > 0) {
+        timedwait_start(&td, fb->fb_wchan, &fb->fb_lock,
+                        timer_mstoticks(msecs));
+    }
+
+    spinlock_acquire(&fb->fb_lock);
+    while (!fw.fw_woken && !uthread_exitpending() &&
+           !(msecs > 0 && td.td_expired)) {
+        wchan_sleep(fb->fb_wchan, &fb->fb_lock);
+    }
+    woken = fw.fw_woken;
+    if (!woken) {
+        futex_unlink(fb, &fw);
+    }
+    spinlock_release(&fb->fb_lock);
+
+    expired = msecs > 0 && timedwait_finish(&td);
+    if (!woken && expired) {
+        return ETIMEDOUT;
+    }
+    // if the process is exiting, we go on the way back to user mode
+    return 0;
+}
+
+/*
+ * wake threads waiting on a futex
+ * ------------
+ *
+ * addr:        user address the waiters passed to futex_wait
+ * count:       wake at most this many, oldest first
+ *
+ * returns:     the number of threads woken
+ */
+int
+futex_wake(userptr_t addr, int count, int *retval)
+{
+    struct proc *proc = curproc;
+    struct futex_bucket *fb;
+    struct futex_waiter **fwp;
+    int n;
+
+    if ((vaddr_t) addr % sizeof(int) != 0 || count < 0) {
+        return EINVAL;
+    }
+
+    fb = futex_hash(proc, (vaddr_t) addr);
+    n = 0;
+
+    spinlock_acquire(&fb->fb_lock);
+    fwp = &fb->fb_head;
+    while (*fwp != NULL && n < count) {
+        if ((*fwp)->fw_proc == proc && (*fwp)->fw_addr == (vaddr_t) addr) {
+            futex_wakeone(fb, fwp);
+            n++;
+        }
+        else {
+            fwp = &(*fwp)->fw_next;
+        }
+    }
+    spinlock_release(&fb->fb_lock);
+
+    *retval = n;
+    return 0;
+}
@@ -22,7 +22,7 @@ open_file_table_create()
         return NULL;
     }
 
-    oft->table_lock = lock_create("filetablelock");
+    oft->table_lock = rwlock_create("filetablelock");
     if (oft->table_lock == NULL) {
         kfree(oft);
         return NULL;
@@ -98,17 +98,19 @@ open_file_table_destroy(struct open_file_table *oft) {
         return;
     }
 
-    lock_destroy(oft->table_lock);
+    rwlock_destroy(oft->table_lock);
     for (int fd = 0; fd < OPEN_MAX; fd++) {
         if (oft->table[fd] != NULL) {
             open_file_decref(oft->table[fd]);
             oft->table[fd] = NULL;
         }
     }
+    kfree(oft);
 }
 
 /*
- * Copies non special fd's from old_oft to new_oft
+ * Makes new_oft a copy of old_oft; whatever new_oft had open before
+ * (such as the special fds from special_fd_create) is closed first
  */
 int
 open_file_table_copy(struct open_file_table *old_oft, struct open_file_table *new_oft) {
@@ -116,9 +118,13 @@ open_file_table_copy(struct open_file_table *old_oft, struct open_file_table *ne
         return -1;
     }
 
-    lock_acquire(old_oft->table_lock);
-    lock_acquire(new_oft->table_lock);
+    rwlock_acquire_read(old_oft->table_lock);
+    rwlock_acquire_write(new_oft->table_lock);
     for (int fd = 0; fd < OPEN_MAX; fd++) {
+        if (new_oft->table[fd] != NULL) {
+            open_file_decref(new_oft->table[fd]);
+            new_oft->table[fd] = NULL;
+        }
         if (old_oft->table[fd] != NULL) {
             //assign any non NULL fd pointers to new_oft at the same index
             new_oft->table[fd] = old_oft->table[fd];
@@ -127,8 +133,8 @@ open_file_table_copy(struct open_file_table *old_oft, struct open_file_table *ne
             open_file_incref(old_oft->table[fd]);
         }
     }
-    lock_release(new_oft->table_lock);
-    lock_release(old_oft->table_lock);
+    rwlock_release_write(new_oft->table_lock);
+    rwlock_release_read(old_oft->table_lock);
 
     return 0;
 }
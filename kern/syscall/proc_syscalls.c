@@ -5,6 +5,7 @@
 #include <mips/trapframe.h>
 #include <thread.h>
 #include <current.h>
+#include <cpu.h>
 #include <syscall.h>
 #include <synch.h>
 #include <proc_syscalls.h>
@@ -23,6 +24,7 @@
 #include <kern/unistd.h>
 #include <addrspace.h>
 #include <kern/wait.h>
+#include <thread_syscalls.h>
 
 /*
  * Support functions.
@@ -35,45 +37,36 @@ void help_enter_forked_process(void *ptr, unsigned long nargs)
 }
 
 /*
- * copy the current process
- * ------------
- *
- * tf:          trapframe of parent process
- *
- * returns:     returns the process id of the new child process in the parent
- *              process
- *              returns 0 in the child process
+ * common code for fork and vfork; a vforked child borrows our address
+ * space instead of getting a copy, and we wait until it execs or exits
  */
+static
 int
-fork(struct trapframe *tf, int *retval)
+do_fork(struct trapframe *tf, bool vforking, int *retval)
 {
     int result;
+    bool vforkdone = false;
 
-
-    // create new process w same name as current process
+    // create new process w same name as current process; this also makes
+    // it our child
     struct proc *child;
     child = proc_create_runprogram("childproc");
     if (child == NULL) {
         return ENPROC;
     }
 
-    // add child pid to array
-    array_add(curproc->childProcs, child, NULL);
-
     // copy stack
-    result = as_copy(curproc->p_addrspace, &child->p_addrspace);
-    if (result) {
-        proc_destroy(child);
-        return result;
+    if (!vforking) {
+        result = as_copy(curproc->p_addrspace, &child->p_addrspace);
+        if (result) {
+            proc_destroy(child);
+            return result;
+        }
     }
 
-    child->oft = open_file_table_create();
-	if (child->oft == NULL) {
-		proc_destroy(child);
-		return ENOMEM;
-	}
-
-    // copy open file table
+    // the child gets its own file table either way, since it may
+    // rearrange it before exec; that's a reference per open file. it
+    // already has one with the console on fds 0-2, so copy into that
     result = open_file_table_copy(curproc->oft, child->oft);
     if (result) {
         proc_destroy(child);
@@ -89,22 +82,75 @@ fork(struct trapframe *tf, int *retval)
 
     memcpy(tempTfCopy, tf, sizeof(struct trapframe));
 
+    // once it's running the child may exit and be reaped by another of
+    // our threads, so get its pid now
+    pid_t pid = child->pid;
+
+    if (vforking) {
+        child->p_addrspace = curproc->p_addrspace;
+        child->p_vforkdone = &vforkdone;
+    }
+
     result = thread_fork("child proc",
                         child,
                         help_enter_forked_process,
                         tempTfCopy,
                         0);
     if (result) {
+        // don't let proc_destroy take our address space with it
+        if (vforking) {
+            child->p_addrspace = NULL;
+            child->p_vforkdone = NULL;
+        }
+        kfree(tempTfCopy);
         proc_destroy(child);
-        return -1;
+        return result;
+    }
+
+    // our address space is the child's until it's done with it
+    if (vforking) {
+        proc_vforkwait(&vforkdone);
     }
 
     // return pid of child process
-    *retval = child->pid;
+    *retval = pid;
 
     return 0;
 }
 
+/*
+ * copy the current process
+ * ------------
+ *
+ * tf:          trapframe of parent process
+ *
+ * returns:     returns the process id of the new child process in the parent
+ *              process
+ *              returns 0 in the child process
+ */
+int
+fork(struct trapframe *tf, int *retval)
+{
+    return do_fork(tf, false, retval);
+}
+
+/*
+ * create a child process to exec something, without copying memory
+ * ------------
+ *
+ * tf:          trapframe of parent process
+ *
+ * returns:     as for fork; but the parent doesn't return until the child
+ *              has called execv or _exit, and until then the child runs in
+ *              the parent's address space (and on its stack), so it must
+ *              not do anything else that the parent would notice
+ */
+int
+vfork(struct trapframe *tf, int *retval)
+{
+    return do_fork(tf, true, retval);
+}
+
 /*
  * helper function for freeing the kernel argument buffer
  */
@@ -259,6 +305,11 @@ int execv(const char *program, char **args)
     }
     kfree(progname);
 
+    // the other threads of this process go away here, even if the exec
+    // later fails; they'd be left running in an address space that is
+    // about to be replaced
+    uthread_killothers();
+
     // create new address space and set process address space to the newly
     // created address space
     struct addrspace *newas = as_create();
@@ -339,7 +390,13 @@ int execv(const char *program, char **args)
     kfree(arg_locs);
     stackptr -= (argc + 1) * (sizeof(char *));
 
-    as_destroy(oldas);
+    // a vforked child gives the old address space back to its parent
+    if (curproc->p_vforkdone != NULL) {
+        proc_vforkdone(curproc);
+    }
+    else {
+        as_destroy(oldas);
+    }
 
     enter_new_process(argc, (userptr_t) stackptr, NULL, stackptr, entrypoint);
     return 0;
@@ -349,81 +406,35 @@ int execv(const char *program, char **args)
  * wait for a process to exit
  * ------------
  *
- * pid:         specifies process to wait on
- * status:      points to encoded exit status integer
- * options:     0
+ * pid:         specifies process to wait on, or WAIT_ANY for any child
+ * status:      points to encoded exit status integer; may be NULL
+ * options:     0 or WNOHANG
  *
- * returns:     returns pid on success and -1 or error code on error
+ * returns:     returns pid on success, or 0 with WNOHANG if no child has
+ *              exited yet, and -1 or error code on error
  */
 int waitpid(int pid, userptr_t status, int options, int *retval)
 {
-    // check options is 0
-    if (options != 0) {
-        return EINVAL;
-    }
+    pid_t childpid;
+    int exitStatus;
 
-    // check pid is valid and points to a proper pid entry
-    if (!get_pid_in_table(pid)){
-        return ESRCH;
-    }
-
-    // check that we are parent of child proc pointed to by pid
-    pid_t curpid = curproc->pid;
-    if (get_parent_pid(pid) != curpid) {
-        return ECHILD;
-    }
-
-
-    int result, exitStatus;
-
-    // scenario 2: child proc w pid has already exited
-    if ( get_pid_exitFlag(pid) ) {
-        // set exit status if status is not a NULL pointer; do nothing if it's
-        // NULL
-        if (status != NULL) {
-            exitStatus = get_pid_exitStatus(pid);
-
-            result = copyout(&exitStatus, status, sizeof(int));
-            if (result) {
-                // EFAULT
-                return result;
-            }
-        }
+    // the child is reaped here whether or not the copyout works
+    int result = proc_waitchild(pid, options, &childpid, &exitStatus);
+    if (result) {
+        return result;
     }
-    // scenario 1: parent is blocked until child exits
-    else {
-        // decrement child_lock semaphore count
-        struct semaphore *exitLock = get_exitLock(pid);
-        // blocks until exit syscall is called on child proc with pid entry 
-        // holding lock
-        P(exitLock);
-
-        // set exit status if status is not a NULL pointer; do nothing if it's
-        // NULL
-        if (status != NULL) {
-            exitStatus = get_pid_exitStatus(pid);
-
-            result = copyout(&exitStatus, status, sizeof(int));
-            if (result) {
-                // EFAULT
-                return result;
-            }
-        }
 
-        // get pid process and destroy it
-        lock_acquire(curproc->childProcsLock);
-        for (unsigned i = 0; i < curproc->childProcs->num; i++) {
-            struct proc *childProc = array_get(curproc->childProcs, i);
-            if (childProc->pid == pid) {
-                array_remove(curproc->childProcs, i);
-                proc_destroy(childProc);
-                break;
-            }
+    // set exit status if status is not a NULL pointer; do nothing if it's
+    // NULL
+    if (childpid != 0 && status != NULL) {
+        result = copyout(&exitStatus, status, sizeof(int));
+        if (result) {
+            // EFAULT
+            return result;
         }
-        lock_release(curproc->childProcsLock);
     }
 
-    *retval = pid;
+    *retval = childpid;
 
     return 0;
 }
@@ -437,32 +448,35 @@ int waitpid(int pid, userptr_t status, int options, int *retval)
  */
 int _exit(int exitcode)
 {
-    // set parentDead flag to true for all of my children
-    lock_acquire(curproc->childProcsLock);
-    while (curproc->childProcs->num > 0) {
-        struct proc *childProc = array_get(curproc->childProcs, 0);
-        if (get_pid_exitFlag(childProc->pid)) {
-            proc_destroy(childProc);
-        } else {
-            childProc->parentDead = true;
-        }
-
-        array_remove(curproc->childProcs, 0);
+    struct proc *proc = curproc;
+
+    // get rid of any other threads first; if one of them is already
+    // exiting the process, this doesn't return
+    uthread_killothers();
+
+    // give back our memory and close our files now rather than whenever
+    // the parent gets round to reaping us
+    // (unless it's borrowed from a vfork parent, which gets it back)
+    struct addrspace *as = proc_setas(NULL);
+    as_deactivate();
+    if (proc->p_vforkdone != NULL) {
+        proc_vforkdone(proc);
     }
+    else if (as != NULL) {
+        as_destroy(as);
+    }
+    open_file_table_destroy(proc->oft);
+    proc->oft = NULL;
 
-    lock_release(curproc->childProcsLock);
-
-
-    pid_t curpid = curproc->pid;
-
-    // set pid exitFlag and proc exitStatus
-    set_pid_exitFlag(curpid, true);
-    set_pid_exitStatus(curpid, exitcode);
+    // reap our zombies and disown the rest of our children
+    proc_orphanchildren(proc);
 
-    // increment child_lock semaphore count to unblock parent thread waiting on
-    // this thread to exit (if any)
-    struct semaphore *exitLock = get_exitLock(curpid);
-    V(exitLock);
+    // leave the proc before handing it to the parent, which may destroy
+    // it straight away; if there is no parent, clean up after ourselves
+    proc_remthread(curthread);
+    if (!proc_zombify(proc, exitcode)) {
+        proc_destroy(proc);
+    }
 
     thread_exit();
 
@@ -485,3 +499,83 @@ int getpid(int *retval)
 
     return 0;
 }
+
+/*
+ * set the cpus a process may run on
+ * ------------
+ *
+ * pid:         0 or our own pid for this process, or one of our children
+ * mask:        bit N set allows cpu N; cpus that don't exist are ignored
+ *
+ * returns:     0 on success; EINVAL if the mask allows no cpu
+ */
+int sched_setaffinity(pid_t pid, unsigned mask)
+{
+    if (pid == 0 || pid == curproc->pid) {
+        // if this cpu is no longer allowed we move on the way out
+        return proc_setaffinity(curproc, mask);
+    }
+
+    // otherwise it must be a child; hold the lock so it can't be
+    // reaped while we're at it
+    int result = ESRCH;
+    lock_acquire(curproc->p_familylock);
+    struct proc *childProc = proc_getchild(pid);
+    if (childProc != NULL) {
+        result = proc_setaffinity(childProc, mask);
+    }
+    lock_release(curproc->p_familylock);
+
+    return result;
+}
+
+/*
+ * get the cpus a process may run on
+ * ------------
+ *
+ * pid:         as for sched_setaffinity
+ * mask:        where to put the mask
+ */
+int sched_getaffinity(pid_t pid, userptr_t mask)
+{
+    struct proc *proc = NULL;
+    unsigned cpumask = 0;
+
+    if (pid == 0 || pid == curproc->pid) {
+        proc = curproc;
+        spinlock_acquire(&proc->p_lock);
+        cpumask = proc->p_cpumask;
+        spinlock_release(&proc->p_lock);
+    }
+    else {
+        lock_acquire(curproc->p_familylock);
+        proc = proc_getchild(pid);
+        if (proc != NULL) {
+            spinlock_acquire(&proc->p_lock);
+            cpumask = proc->p_cpumask;
+            spinlock_release(&proc->p_lock);
+        }
+        lock_release(curproc->p_familylock);
+    }
+
+    if (proc == NULL) {
+        return ESRCH;
+    }
+
+    return copyout(&cpumask, mask, sizeof(unsigned));
+}
+
+/*
+ * which cpu are we on
+ * ------------
+ *
+ * returns:     the number of the cpu the caller was running on; it may
+ *              have moved by the time it looks, unless its affinity
+ *              allows only one
+ */
+int sched_getcpu(int *retval)
+{
+    *retval = curcpu->c_number;
+
+    return 0;
+}
@@ -0,0 +1,422 @@
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/wait.h>
+#include <lib.h>
+#include <array.h>
+#include <thread.h>
+#include <current.h>
+#include <syscall.h>
+#include <synch.h>
+#include <proc.h>
+#include <vm.h>
+#include <copyinout.h>
+#include <proc_syscalls.h>
+#include <thread_syscalls.h>
+#include <futex_syscalls.h>
+
+/*
+ * User-level threads.
+ *
+ * Each user thread is just another kernel thread attached to the same
+ * struct proc, so it shares the address space and open file table with
+ * the rest of the process. The first thread_create sets up the
+ * bookkeeping in the proc; until then a process has no extra cost.
+ *
+ * The main thread has tid 0 and can't be joined. Every other thread
+ * gets a struct uthread record that lives until somebody joins it (or
+ * the process goes away).
+ *
+ * Two counts are kept: p_nlive is the number of threads that haven't
+ * started exiting, and decides which thread is the last one out and
+ * must exit the whole process; p_nattached is the number of threads
+ * still attached to the proc, and is what _exit and execv wait on
+ * before tearing the process down.
+ *
+ * When a thread calls _exit or execv, every other thread has to go.
+ * We set p_exiting and wait for them; the others notice it in mips_trap
+ * on their way back to user mode, or in thread_join, and exit. A thread
+ * that is blocked in the kernel for a long time (e.g. in read on the
+ * console) holds up the exiting thread until it gets out.
+ */
+
+/*
+ * arguments for a new thread, handed over by uthread_create
+ */
+struct uthread_start {
+    vaddr_t us_entry;
+    userptr_t us_arg;
+    vaddr_t us_stack;
+    vaddr_t us_gp;              // creator's global pointer; see below
+    struct uthread *us_ut;
+};
+
+/*
+ * Support functions.
+ */
+
+/*
+ * set up the process's thread bookkeeping on first use; we are the only
+ * thread at this point, so there's no one to race with
+ */
+static
+int
+uthread_setup(struct proc *proc)
+{
+    if (proc->p_uthreadlock != NULL) {
+        return 0;
+    }
+
+    proc->p_uthreads = array_create();
+    proc->p_uthreadcv = cv_create("uthreadcv");
+    proc->p_uthreadlock = lock_create("uthreadlock");
+    if (proc->p_uthreads == NULL || proc->p_uthreadcv == NULL ||
+        proc->p_uthreadlock == NULL) {
+        if (proc->p_uthreads) {
+            array_destroy(proc->p_uthreads);
+            proc->p_uthreads = NULL;
+        }
+        if (proc->p_uthreadcv) {
+            cv_destroy(proc->p_uthreadcv);
+            proc->p_uthreadcv = NULL;
+        }
+        if (proc->p_uthreadlock) {
+            lock_destroy(proc->p_uthreadlock);
+            proc->p_uthreadlock = NULL;
+        }
+        return ENOMEM;
+    }
+    return 0;
+}
+
+/*
+ * look up a thread record by tid; p_uthreadlock must be held
+ */
+static
+struct uthread *
+uthread_find(struct proc *proc, int tid, unsigned *index)
+{
+    for (unsigned i = 0; i < array_num(proc->p_uthreads); i++) {
+        struct uthread *ut = array_get(proc->p_uthreads, i);
+        if (ut->ut_tid == tid) {
+            *index = i;
+            return ut;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Detach the current thread from its process and exit it, recording
+ * STATUS for thread_join. The caller has already taken the thread out
+ * of p_nlive.
+ */
+static
+__DEAD void
+uthread_detach(int status)
+{
+    struct proc *proc = curproc;
+
+    // leave the proc before saying so, so that once p_nattached drops
+    // nothing of ours is left for _exit to tear down
+    proc_remthread(curthread);
+
+    lock_acquire(proc->p_uthreadlock);
+    for (unsigned i = 0; i < array_num(proc->p_uthreads); i++) {
+        struct uthread *ut = array_get(proc->p_uthreads, i);
+        if (ut->ut_thread == curthread) {
+            ut->ut_thread = NULL;
+            ut->ut_exited = true;
+            ut->ut_status = status;
+            break;
+        }
+    }
+    proc->p_nattached--;
+    cv_broadcast(proc->p_uthreadcv, proc->p_uthreadlock);
+    lock_release(proc->p_uthreadlock);
+
+    thread_exit();
+}
+
+/*
+ * exit the current thread because another one is exiting the process
+ */
+static
+__DEAD void
+uthread_die(void)
+{
+    struct proc *proc = curproc;
+
+    lock_acquire(proc->p_uthreadlock);
+    KASSERT(proc->p_nlive > 1);
+    proc->p_nlive--;
+    lock_release(proc->p_uthreadlock);
+
+    uthread_detach(0);
+}
+
+/*
+ * first function run by a new user thread
+ */
+static
+void
+uthread_start(void *data, unsigned long unused)
+{
+    struct uthread_start start;
+    struct proc *proc = curproc;
+
+    (void) unused;
+
+    start = *(struct uthread_start *) data;
+    kfree(data);
+
+    lock_acquire(proc->p_uthreadlock);
+    start.us_ut->ut_thread = curthread;
+    lock_release(proc->p_uthreadlock);
+
+    // the process may have started exiting before we got to run
+    uthread_exitcheck();
+
+    enter_new_thread(start.us_arg, start.us_stack, start.us_entry,
+                     start.us_gp);
+}
+
+/*
+ * create a new thread in the current process
+ * ------------
+ *
+ * entry:       user function the thread starts in
+ * arg:         passed to entry in a0
+ * stack:       initial user stack pointer; the caller provides the stack
+ * gp:          the caller's global pointer. Only crt0 sets gp, and
+ *              userland reaches small globals (errno, for one) through
+ *              it, so the new thread gets the same one.
+ *
+ * returns:     the new thread's id
+ */
+int
+uthread_create(userptr_t entry, userptr_t arg, userptr_t stack, vaddr_t gp,
+               int *retval)
+{
+    struct proc *proc = curproc;
+    struct uthread_start *start;
+    struct uthread *ut;
+    unsigned index;
+    int result;
+
+    // the thread would fault straight away; catch it here instead
+    if (entry == NULL || (vaddr_t) entry >= USERSPACETOP ||
+        stack == NULL || (vaddr_t) stack > USERSPACETOP) {
+        return EFAULT;
+    }
+
+    result = uthread_setup(proc);
+    if (result) {
+        return result;
+    }
+
+    ut = kmalloc(sizeof(struct uthread));
+    if (ut == NULL) {
+        return ENOMEM;
+    }
+    start = kmalloc(sizeof(struct uthread_start));
+    if (start == NULL) {
+        kfree(ut);
+        return ENOMEM;
+    }
+
+    lock_acquire(proc->p_uthreadlock);
+
+    ut->ut_tid = proc->p_nexttid++;
+    ut->ut_thread = NULL;
+    ut->ut_exited = false;
+    ut->ut_status = 0;
+    result = array_add(proc->p_uthreads, ut, &index);
+    if (result) {
+        lock_release(proc->p_uthreadlock);
+        kfree(start);
+        kfree(ut);
+        return result;
+    }
+
+    start->us_entry = (vaddr_t) entry;
+    start->us_arg = arg;
+    start->us_stack = (vaddr_t) stack;
+    start->us_gp = gp;
+    start->us_ut = ut;
+
+    // the new thread counts from now on, so _exit will wait for it;
+    // it can't get anywhere until we drop the lock
+    proc->p_nlive++;
+    proc->p_nattached++;
+
+    result = thread_fork(proc->p_name, proc, uthread_start, start, 0);
+    if (result) {
+        proc->p_nlive--;
+        proc->p_nattached--;
+        array_remove(proc->p_uthreads, index);
+        lock_release(proc->p_uthreadlock);
+        kfree(start);
+        kfree(ut);
+        return result;
+    }
+
+    *retval = ut->ut_tid;
+
+    lock_release(proc->p_uthreadlock);
+
+    return 0;
+}
+
+/*
+ * wait for a thread to exit
+ * ------------
+ *
+ * tid:         thread to wait for
+ * status:      where to put its exit status; may be NULL
+ *
+ * returns:     tid on success; each thread can be joined only once
+ */
+int
+uthread_join(int tid, userptr_t status, int *retval)
+{
+    struct proc *proc = curproc;
+    struct uthread *ut;
+    unsigned index;
+    int exitstatus, result;
+
+    // tid 0 is the main thread, which never gets a record
+    if (tid <= 0) {
+        return EINVAL;
+    }
+    if (proc->p_uthreadlock == NULL) {
+        return ESRCH;
+    }
+
+    lock_acquire(proc->p_uthreadlock);
+    while (1) {
+        // look it up afresh each time; another joiner may have won
+        ut = uthread_find(proc, tid, &index);
+        if (ut == NULL) {
+            lock_release(proc->p_uthreadlock);
+            return ESRCH;
+        }
+        if (ut->ut_thread == curthread) {
+            lock_release(proc->p_uthreadlock);
+            return EINVAL;
+        }
+        if (ut->ut_exited) {
+            break;
+        }
+        if (proc->p_exiting) {
+            lock_release(proc->p_uthreadlock);
+            uthread_die();
+        }
+        cv_wait(proc->p_uthreadcv, proc->p_uthreadlock);
+    }
+
+    exitstatus = ut->ut_status;
+    array_remove(proc->p_uthreads, index);
+    kfree(ut);
+    lock_release(proc->p_uthreadlock);
+
+    if (status != NULL) {
+        result = copyout(&exitstatus, status, sizeof(int));
+        if (result) {
+            return result;
+        }
+    }
+
+    *retval = tid;
+
+    return 0;
+}
+
+/*
+ * terminate the current thread
+ * ------------
+ *
+ * status:      reported to thread_join; if this is the last thread, the
+ *              whole process exits with it instead
+ */
+int
+uthread_exit(int status)
+{
+    struct proc *proc = curproc;
+
+    if (proc->p_uthreadlock == NULL) {
+        return _exit(_MKWAIT_EXIT(status));
+    }
+
+    lock_acquire(proc->p_uthreadlock);
+    if (proc->p_nlive == 1) {
+        lock_release(proc->p_uthreadlock);
+        return _exit(_MKWAIT_EXIT(status));
+    }
+    proc->p_nlive--;
+    lock_release(proc->p_uthreadlock);
+
+    uthread_detach(status);
+}
+
+/*
+ * Make every other thread in the current process exit, and wait until
+ * they have all detached. Called by _exit and execv. If another thread
+ * got there first, we're one of the ones that has to go.
+ */
+void
+uthread_killothers(void)
+{
+    struct proc *proc = curproc;
+
+    if (proc->p_uthreadlock == NULL) {
+        // never had any other threads
+        return;
+    }
+
+    lock_acquire(proc->p_uthreadlock);
+    if (proc->p_exiting) {
+        lock_release(proc->p_uthreadlock);
+        uthread_die();
+    }
+
+    proc->p_exiting = true;
+    // get joiners out of cv_wait and futex waiters out of futex_wait;
+    // everyone else notices in mips_trap
+    cv_broadcast(proc->p_uthreadcv, proc->p_uthreadlock);
+    futex_wakeproc(proc);
+    while (proc->p_nattached > 1) {
+        cv_wait(proc->p_uthreadcv, proc->p_uthreadlock);
+    }
+    proc->p_exiting = false;
+    KASSERT(proc->p_nlive == 1);
+
+    // nobody is left to join these; exec'd programs start afresh
+    while (array_num(proc->p_uthreads) > 0) {
+        kfree(array_get(proc->p_uthreads, 0));
+        array_remove(proc->p_uthreads, 0);
+    }
+    lock_release(proc->p_uthreadlock);
+}
+
+/*
+ * true if the current thread should exit because another thread is
+ * taking the process down
+ */
+bool
+uthread_exitpending(void)
+{
+    struct proc *proc = curproc;
+
+    return proc != NULL && proc->p_exiting;
+}
+
+/*
+ * called on the way back to user mode: exit if we must
+ */
+void
+uthread_exitcheck(void)
+{
+    if (uthread_exitpending()) {
+        uthread_die();
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * RCU test code.
+ *
+ * Reader threads keep looking at a shared object without locking
+ * while the main thread keeps replacing it and handing the old one to
+ * rcu_defer, which poisons it before freeing it. If an object were
+ * reclaimed while a reader could still see it, the reader would find
+ * the poison.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <rcu.h>
+#include <test.h>
+
+#define NREADERS	4
+#define NSWAPS		200
+#define RCU_MAGIC	0x600dc0deU
+#define RCU_POISON	0xdeadbeefU
+
+struct rcuobj {
+	volatile unsigned ro_magic;
+	unsigned ro_num;
+	struct rcu_head ro_rcu;
+};
+
+static struct rcuobj *volatile rcuptr;
+static struct semaphore *rcudonesem;
+static struct semaphore *rcufreesem;
+static volatile bool rcustop;
+static volatile bool rcufailed;
+
+static
+void
+rcufree(void *data)
+{
+	struct rcuobj *ro = data;
+
+	ro->ro_magic = RCU_POISON;
+	kfree(ro);
+	V(rcufreesem);
+}
+
+static
+void
+rcureader(void *junk, unsigned long num)
+{
+	struct rcuobj *ro;
+	unsigned long reads;
+	int spl;
+
+	(void)junk;
+
+	reads = 0;
+	while (!rcustop) {
+		spl = rcu_read_lock();
+		ro = rcuptr;
+		if (ro->ro_magic != RCU_MAGIC) {
+			rcufailed = true;
+		}
+		rcu_read_unlock(spl);
+		reads++;
+	}
+	kprintf("rcutest: reader %lu did %lu reads\n", num, reads);
+	V(rcudonesem);
+}
+
+static
+struct rcuobj *
+rcunew(unsigned num)
+{
+	struct rcuobj *ro;
+
+	ro = kmalloc(sizeof(*ro));
+	if (ro == NULL) {
+		panic("rcutest: Out of memory\n");
+	}
+	ro->ro_magic = RCU_MAGIC;
+	ro->ro_num = num;
+	return ro;
+}
+
+int
+rcutest(int nargs, char **args)
+{
+	struct rcuobj *old;
+	struct timespec before, after;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	kprintf("Starting RCU test...\n");
+	rcudonesem = sem_create("rcudone", 0);
+	rcufreesem = sem_create("rcufree", 0);
+	if (rcudonesem == NULL || rcufreesem == NULL) {
+		panic("rcutest: sem_create failed\n");
+	}
+	rcustop = false;
+	rcufailed = false;
+	rcuptr = rcunew(0);
+
+	for (i=0; i<NREADERS; i++) {
+		result = thread_fork("rcureader", NULL, rcureader, NULL, i);
+		if (result) {
+			panic("rcutest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	gettime(&before);
+	for (i=1; i<=NSWAPS; i++) {
+		old = rcuptr;
+		rcu_assign(rcuptr, rcunew(i));
+		rcu_defer(&old->ro_rcu, rcufree, old);
+		if (i % 10 == 0) {
+			thread_yield();
+		}
+	}
+	/* Every replaced object has to be reclaimed eventually. */
+	for (i=0; i<NSWAPS; i++) {
+		P(rcufreesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
+
+	rcustop = true;
+	for (i=0; i<NREADERS; i++) {
+		P(rcudonesem);
+	}
+	kprintf("rcutest: %u objects reclaimed in %llu.%03u seconds\n",
+		NSWAPS, (unsigned long long)after.tv_sec,
+		after.tv_nsec / 1000000);
+
+	kfree(rcuptr);
+	rcuptr = NULL;
+	sem_destroy(rcudonesem);
+	sem_destroy(rcufreesem);
+	kprintf("RCU test %s.\n", rcufailed ? "FAILED" : "done");
+	return 0;
+}
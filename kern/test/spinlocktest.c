@@ -0,0 +1,120 @@
+/*
+ * Spinlock stress test.
+ *
+ * One thread per cpu, each bound to its cpu, all hammering the same
+ * spinlock for a while. Checks that the lock excludes (an unprotected
+ * read-modify-write of a shared counter must not lose updates) and
+ * prints how many times each cpu got the lock, which for a fair lock
+ * should come out about even.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+#define RUN_MSECS	1000
+#define MAXCPUS		32
+
+static struct spinlock sltestlock = SPINLOCK_INITIALIZER;
+static struct semaphore *sldonesem;
+static volatile unsigned long slcounter;
+static volatile unsigned long slcounts[MAXCPUS];
+static volatile bool slstop;
+
+static
+void
+slthread(void *junk, unsigned long num)
+{
+	volatile unsigned long val;
+	volatile int j;
+
+	(void)junk;
+
+	while (!slstop) {
+		spinlock_acquire(&sltestlock);
+		/* Deliberately slow increment, to widen any race. */
+		val = slcounter;
+		for (j=0; j<10; j++);
+		slcounter = val + 1;
+		slcounts[num]++;
+		spinlock_release(&sltestlock);
+
+		/* A little work outside the lock. */
+		for (j=0; j<20; j++);
+	}
+	V(sldonesem);
+}
+
+int
+spinlocktest(int nargs, char **args)
+{
+	unsigned i, ncpus;
+	unsigned long total, min, max;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	if (sldonesem == NULL) {
+		sldonesem = sem_create("sldonesem", 0);
+		if (sldonesem == NULL) {
+			panic("spinlocktest: sem_create failed\n");
+		}
+	}
+
+	ncpus = cpu_count();
+	if (ncpus > MAXCPUS) {
+		ncpus = MAXCPUS;
+	}
+	kprintf("Starting spinlock stress test on %u cpus...\n", ncpus);
+
+	slstop = false;
+	slcounter = 0;
+	for (i=0; i<ncpus; i++) {
+		slcounts[i] = 0;
+	}
+	for (i=0; i<ncpus; i++) {
+		result = thread_fork_bound(cpu_get(i), "spinlocktest", NULL,
+					   slthread, NULL, i);
+		if (result) {
+			panic("spinlocktest: thread_fork_bound failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	timer_sleep(timer_mstoticks(RUN_MSECS));
+	slstop = true;
+	for (i=0; i<ncpus; i++) {
+		P(sldonesem);
+	}
+
+	total = 0;
+	min = max = slcounts[0];
+	for (i=0; i<ncpus; i++) {
+		kprintf("cpu%u: %lu\n", i, slcounts[i]);
+		total += slcounts[i];
+		if (slcounts[i] < min) {
+			min = slcounts[i];
+		}
+		if (slcounts[i] > max) {
+			max = slcounts[i];
+		}
+	}
+	kprintf("%lu acquires in %u ms; fewest %lu, most %lu per cpu\n",
+		total, RUN_MSECS, min, max);
+
+	if (slcounter != total) {
+		kprintf("spinlocktest: counter is %lu, expected %lu\n",
+			slcounter, total);
+		kprintf("Spinlock stress test FAILED.\n");
+	}
+	else {
+		kprintf("Spinlock stress test done.\n");
+	}
+	return 0;
+}
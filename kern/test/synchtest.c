@@ -34,6 +34,7 @@
 #include <types.h>
 #include <lib.h>
 #include <clock.h>
+#include <spinlock.h>
 #include <thread.h>
 #include <synch.h>
 #include <test.h>
@@ -42,6 +43,9 @@
 #define NLOCKLOOPS    120
 #define NCVLOOPS      5
 #define NTHREADS      32
+#define NBENCHTHREADS 8
+#define NBENCHLOOPS   2000
+#define NRWLOOPS      40
 
 static volatile unsigned long testval1;
 static volatile unsigned long testval2;
@@ -269,7 +273,7 @@ cvtestthread(void *junk, unsigned long num)
 int
 cvtest(int nargs, char **args)
 {
-
+	struct timespec before, after;
 	int i, result;
 
 	(void)nargs;
@@ -281,6 +285,8 @@ cvtest(int nargs, char **args)
 
 	testval1 = NTHREADS-1;
 
+	gettime(&before);
+
 	for (i=0; i<NTHREADS; i++) {
 		result = thread_fork("synchtest", NULL, cvtestthread, NULL, i);
 		if (result) {
@@ -291,8 +297,11 @@ cvtest(int nargs, char **args)
 	for (i=0; i<NTHREADS; i++) {
 		P(donesem);
 	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
 
-	kprintf("CV test done\n");
+	kprintf("CV test done (%llu.%03u seconds)\n",
+		(unsigned long long)after.tv_sec, after.tv_nsec / 1000000);
 
 	return 0;
 }
@@ -359,6 +368,7 @@ wakethread(void *junk1, unsigned long junk2)
 int
 cvtest2(int nargs, char **args)
 {
+	struct timespec before, after;
 	unsigned i;
 	int result;
 
@@ -374,6 +384,7 @@ cvtest2(int nargs, char **args)
 
 	kprintf("cvtest2...\n");
 
+	gettime(&before);
 	result = thread_fork("cvtest2", NULL, sleepthread, NULL, 0);
 	if (result) {
 		panic("cvtest2: thread_fork failed\n");
@@ -385,6 +396,8 @@ cvtest2(int nargs, char **args)
 
 	P(exitsem);
 	P(exitsem);
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
 
 	sem_destroy(exitsem);
 	sem_destroy(gatesem);
@@ -396,6 +409,297 @@ cvtest2(int nargs, char **args)
 		testcvs[i] = NULL;
 	}
 
-	kprintf("cvtest2 done\n");
+	kprintf("cvtest2 done (%llu.%03u seconds)\n",
+		(unsigned long long)after.tv_sec, after.tv_nsec / 1000000);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Lock contention benchmark.
+//
+// A few threads hammer one lock with a very short critical section,
+// like the open file table locks see. Run it once with lock waiters
+// always sleeping and once with adaptive spinning, and compare.
+
+static volatile unsigned long benchcount;
+
+static
+void
+lockbenchthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+	(void)num;
+
+	for (i=0; i<NBENCHLOOPS; i++) {
+		lock_acquire(testlock);
+		benchcount++;
+		for (j=0; j<20; j++);
+		lock_release(testlock);
+
+		/* a little work outside the lock */
+		for (j=0; j<100; j++);
+	}
+	V(donesem);
+}
+
+static
+void
+lockbenchrun(bool spinning)
+{
+	struct timespec before, after;
+	unsigned long ops;
+	unsigned msecs;
+	int i, result;
+
+	lock_spinning = spinning;
+	benchcount = 0;
+	gettime(&before);
+	for (i=0; i<NBENCHTHREADS; i++) {
+		result = thread_fork("lockbench", NULL, lockbenchthread,
+				     NULL, i);
+		if (result) {
+			panic("lockbench: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NBENCHTHREADS; i++) {
+		P(donesem);
+	}
+	gettime(&after);
+	timespec_sub(&after, &before, &after);
+
+	ops = NBENCHTHREADS * NBENCHLOOPS;
+	if (benchcount != ops) {
+		kprintf("lockbench: count is %lu, expected %lu\n",
+			benchcount, ops);
+	}
+	msecs = after.tv_sec * 1000 + after.tv_nsec / 1000000;
+	kprintf("%s: %lu acquires in %u ms (%lu/sec)\n",
+		spinning ? "adaptive" : "sleeping", ops, msecs,
+		msecs == 0 ? 0 : ops * 1000 / msecs);
+}
+
+int
+lockbench(int nargs, char **args)
+{
+	bool wasspinning;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	kprintf("Starting lock contention benchmark...\n");
+
+	wasspinning = lock_spinning;
+	lockbenchrun(false);
+	lockbenchrun(true);
+	lock_spinning = wasspinning;
+
+	kprintf("Lock contention benchmark done.\n");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock test.
+//
+// Every fourth thread is a writer. Writers scribble on the test
+// values; readers check that they never see a half-done write, and
+// everyone checks that writers are alone and readers only share with
+// other readers. We also count how many readers were in at once, which
+// should be more than one.
+
+static struct rwlock *testrw;
+static struct spinlock rwcountlock = SPINLOCK_INITIALIZER;
+static volatile unsigned rwreaders, rwwriters, rwmaxreaders;
+static volatile bool rwfailed;
+
+static
+void
+rwcheck(unsigned long num, bool ok, const char *msg)
+{
+	if (!ok) {
+		kprintf("thread %lu: %s\n", num, msg);
+		rwfailed = true;
+	}
+}
+
+static
+void
+rwtestthread(void *junk, unsigned long num)
+{
+	int i;
+	volatile int j;
+
+	(void)junk;
+
+	for (i=0; i<NRWLOOPS; i++) {
+		if (num % 4 == 0) {
+			rwlock_acquire_write(testrw);
+			spinlock_acquire(&rwcountlock);
+			rwwriters++;
+			rwcheck(num, rwwriters == 1 && rwreaders == 0,
+				"writer not alone");
+			spinlock_release(&rwcountlock);
+
+			testval1 = num;
+			thread_yield();
+			testval2 = num*num;
+
+			spinlock_acquire(&rwcountlock);
+			rwwriters--;
+			spinlock_release(&rwcountlock);
+			rwlock_release_write(testrw);
+		}
+		else {
+			rwlock_acquire_read(testrw);
+			spinlock_acquire(&rwcountlock);
+			rwreaders++;
+			if (rwreaders > rwmaxreaders) {
+				rwmaxreaders = rwreaders;
+			}
+			rwcheck(num, rwwriters == 0, "reader with a writer");
+			spinlock_release(&rwcountlock);
+
+			rwcheck(num, testval2 == testval1*testval1,
+				"saw a partial write");
+			for (j=0; j<100; j++);
+			thread_yield();
+
+			spinlock_acquire(&rwcountlock);
+			rwreaders--;
+			spinlock_release(&rwcountlock);
+			rwlock_release_read(testrw);
+		}
+	}
+	V(donesem);
+}
+
+int
+rwtest(int nargs, char **args)
+{
+	int i, result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (testrw == NULL) {
+		testrw = rwlock_create("testrw");
+		if (testrw == NULL) {
+			panic("rwtest: rwlock_create failed\n");
+		}
+	}
+	kprintf("Starting rwlock test...\n");
+
+	testval1 = testval2 = 0;
+	rwmaxreaders = 0;
+	rwfailed = false;
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("rwtest", NULL, rwtestthread, NULL, i);
+		if (result) {
+			panic("rwtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		P(donesem);
+	}
+
+	kprintf("Up to %u readers at once\n", rwmaxreaders);
+	kprintf("Rwlock test %s.\n", rwfailed ? "FAILED" : "done");
+	return 0;
+}
+
+////////////////////////////////////////////////////////////
+//
+// FIFO (handoff) semaphore test.
+//
+// Line threads up on a handoff semaphore one at a time, then V it
+// once per thread and check they come out in the order they went in.
+// While that happens, a second batch of threads calls P at the same
+// time; none of them may get a unit before the whole first batch has.
+
+static struct semaphore *fifosem;
+static volatile unsigned long fifoorder[NTHREADS*2];
+static volatile unsigned fifonext;
+
+static
+void
+fifotestthread(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	P(fifosem);
+	fifoorder[fifonext++] = num;
+	V(donesem);
+}
+
+int
+semtest2(int nargs, char **args)
+{
+	int i, result;
+	bool failed;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	if (fifosem == NULL) {
+		fifosem = sem_create_fifo("fifosem", 0);
+		if (fifosem == NULL) {
+			panic("semtest2: sem_create_fifo failed\n");
+		}
+	}
+	kprintf("Starting FIFO semaphore test...\n");
+
+	for (i=0; i<NTHREADS; i++) {
+		result = thread_fork("semtest2", NULL, fifotestthread,
+				     NULL, i);
+		if (result) {
+			panic("semtest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		/* Wait until it's in line before starting the next. */
+		while (fifosem->sem_nwaiting < (unsigned)i + 1) {
+			thread_yield();
+		}
+	}
+
+	/* Latecomers; these race with the V calls below. */
+	for (i=NTHREADS; i<NTHREADS*2; i++) {
+		result = thread_fork("semtest2", NULL, fifotestthread,
+				     NULL, i);
+		if (result) {
+			panic("semtest2: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	fifonext = 0;
+	for (i=0; i<NTHREADS; i++) {
+		V(fifosem);
+		P(donesem);
+	}
+
+	failed = false;
+	for (i=0; i<NTHREADS; i++) {
+		if (fifoorder[i] != (unsigned long)i) {
+			kprintf("semtest2: thread %lu came out %dth\n",
+				fifoorder[i], i);
+			failed = true;
+		}
+	}
+
+	/* Let the latecomers through, in whatever order they got in. */
+	for (i=0; i<NTHREADS; i++) {
+		V(fifosem);
+		P(donesem);
+	}
+kprintf("FIFO semaphore test %s.\n", failed ? "FAILED" : "done");
 	return 0;
 }
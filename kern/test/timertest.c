@@ -0,0 +1,207 @@
+/*
+ * Timer test code.
+ *
+ * Checks that timed sleeps last about as long as asked (never less),
+ * that timed waits time out when nobody wakes them, and that they
+ * return promptly when somebody does.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <synch.h>
+#include <timer.h>
+#include <test.h>
+
+#define NSLEEPERS	8
+#define SLEEP_MSECS	50	/* sleeper N sleeps (N+1) * SLEEP_MSECS */
+#define WAIT_MSECS	200
+
+static struct semaphore *tmsem;
+static struct semaphore *tmdonesem;
+static struct lock *tmlock;
+static struct cv *tmcv;
+static volatile unsigned tmorder;
+static volatile bool tmfailed;
+
+static
+void
+inititems(void)
+{
+	if (tmsem == NULL) {
+		tmsem = sem_create("tmsem", 0);
+		if (tmsem == NULL) {
+			panic("timertest: sem_create failed\n");
+		}
+	}
+	if (tmdonesem == NULL) {
+		tmdonesem = sem_create("tmdonesem", 0);
+		if (tmdonesem == NULL) {
+			panic("timertest: sem_create failed\n");
+		}
+	}
+	if (tmlock == NULL) {
+		tmlock = lock_create("tmlock");
+		if (tmlock == NULL) {
+			panic("timertest: lock_create failed\n");
+		}
+	}
+	if (tmcv == NULL) {
+		tmcv = cv_create("tmcv");
+		if (tmcv == NULL) {
+			panic("timertest: cv_create failed\n");
+		}
+	}
+}
+
+/*
+ * Return elapsed milliseconds since BEFORE.
+ */
+static
+unsigned
+msecs_since(const struct timespec *before)
+{
+	struct timespec now, diff;
+
+	gettime(&now);
+	timespec_sub(&now, before, &diff);
+	return diff.tv_sec * 1000 + diff.tv_nsec / 1000000;
+}
+
+/*
+ * Check a measured duration against the requested one. Timers round
+ * up to hardclocks, so allow a few hardclocks of slack on the long
+ * side, plus some for the scheduler.
+ */
+static
+void
+checkduration(const char *what, unsigned got, unsigned want)
+{
+	unsigned slack = 3 * 1000 / HZ + 20;
+
+	if (got < want || got > want + slack) {
+		kprintf("timertest: %s took %u ms, expected %u\n",
+			what, got, want);
+		tmfailed = true;
+	}
+}
+
+static
+void
+sleeperthread(void *junk, unsigned long num)
+{
+	struct timespec before;
+	unsigned msecs;
+
+	(void)junk;
+
+	msecs = (num + 1) * SLEEP_MSECS;
+	gettime(&before);
+	timer_sleep(timer_mstoticks(msecs));
+	checkduration("timer_sleep", msecs_since(&before), msecs);
+
+	/* Sleepers should wake up in order of their sleep time. */
+	if (tmorder != num) {
+		kprintf("timertest: sleeper %lu woke up %uth\n", num, tmorder);
+		tmfailed = true;
+	}
+	tmorder++;
+	V(tmdonesem);
+}
+
+static
+void
+signalthread(void *junk, unsigned long num)
+{
+	(void)junk;
+	(void)num;
+
+	/* Wait a bit so the main thread is asleep, then wake it. */
+	timer_sleep(timer_mstoticks(WAIT_MSECS / 4));
+	V(tmsem);
+	timer_sleep(timer_mstoticks(WAIT_MSECS / 4));
+	lock_acquire(tmlock);
+	cv_signal(tmcv, tmlock);
+	lock_release(tmlock);
+	V(tmdonesem);
+}
+
+int
+timertest(int nargs, char **args)
+{
+	struct timespec before;
+	unsigned i, got;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	tmfailed = false;
+	kprintf("Starting timer test...\n");
+
+	/* Timed sleeps, staggered so they finish one after the other. */
+	tmorder = 0;
+	for (i=NSLEEPERS; i-- > 0; ) {
+		result = thread_fork("timertest", NULL, sleeperthread,
+				     NULL, i);
+		if (result) {
+			panic("timertest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<NSLEEPERS; i++) {
+		P(tmdonesem);
+	}
+
+	/* Nobody wakes us: both kinds of timed wait should time out. */
+	gettime(&before);
+	result = P_timed(tmsem, WAIT_MSECS);
+	if (result != ETIMEDOUT) {
+		kprintf("timertest: P_timed returned %d, expected "
+			"ETIMEDOUT\n", result);
+		tmfailed = true;
+	}
+	checkduration("P_timed", msecs_since(&before), WAIT_MSECS);
+
+	lock_acquire(tmlock);
+	gettime(&before);
+	result = cv_timedwait(tmcv, tmlock, WAIT_MSECS);
+	got = msecs_since(&before);
+	KASSERT(lock_do_i_hold(tmlock));
+	lock_release(tmlock);
+	if (result != ETIMEDOUT) {
+		kprintf("timertest: cv_timedwait returned %d, expected "
+			"ETIMEDOUT\n", result);
+		tmfailed = true;
+	}
+	checkduration("cv_timedwait", got, WAIT_MSECS);
+
+	/* Now somebody does wake us, well before the timeout. */
+	result = thread_fork("timertest", NULL, signalthread, NULL, 0);
+	if (result) {
+		panic("timertest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	result = P_timed(tmsem, WAIT_MSECS * 10);
+	if (result != 0) {
+		kprintf("timertest: woken P_timed returned %d\n", result);
+		tmfailed = true;
+	}
+	lock_acquire(tmlock);
+	gettime(&before);
+	result = cv_timedwait(tmcv, tmlock, WAIT_MSECS * 10);
+	got = msecs_since(&before);
+	lock_release(tmlock);
+	if (result != 0 || got >= WAIT_MSECS * 10) {
+		kprintf("timertest: woken cv_timedwait returned %d "
+			"after %u ms\n", result, got);
+		tmfailed = true;
+	}
+	P(tmdonesem);
+
+	kprintf("Timer test %s.\n", tmfailed ? "FAILED" : "done");
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Workqueue test code.
+ *
+ * Checks that queued work runs, that a burst of it gets batched, that
+ * enqueueing an item that's already pending does nothing, that delayed
+ * work waits out its delay and can be cancelled, and that work can be
+ * queued from interrupt context.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <clock.h>
+#include <spl.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <synch.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <test.h>
+
+#define NITEMS		32
+#define DELAY_MSECS	100
+
+static struct semaphore *wqsem;
+static struct work wqitems[NITEMS];
+static volatile unsigned wqruns[NITEMS];
+static volatile bool wqfailed;
+
+static
+void
+inititems(void)
+{
+	if (wqsem == NULL) {
+		wqsem = sem_create("wqsem", 0);
+		if (wqsem == NULL) {
+			panic("wqtest: sem_create failed\n");
+		}
+	}
+}
+
+static
+void
+workfunc(void *data)
+{
+	unsigned num = (uintptr_t)data;
+
+	KASSERT(!curthread->t_in_interrupt);
+	wqruns[num]++;
+	V(wqsem);
+}
+
+/*
+ * Timer function: runs in hardclock, and queues item 0 from there.
+ */
+static
+void
+timerfunc(void *data)
+{
+	(void)data;
+	if (!workqueue_enqueue(&wqitems[0])) {
+		kprintf("wqtest: enqueue from interrupt refused\n");
+		wqfailed = true;
+	}
+}
+
+static
+void
+checkruns(const char *what, unsigned num, unsigned want)
+{
+	if (wqruns[num] != want) {
+		kprintf("wqtest: %s: item %u ran %u times, expected %u\n",
+			what, num, wqruns[num], want);
+		wqfailed = true;
+	}
+}
+
+int
+wqtest(int nargs, char **args)
+{
+	struct workqueue *wq;
+	struct timer tm;
+	struct timespec before, after, diff;
+	unsigned i, msecs, batches, items;
+	int spl;
+
+	(void)nargs;
+	(void)args;
+
+	inititems();
+	wqfailed = false;
+	kprintf("Starting workqueue test...\n");
+
+	for (i=0; i<NITEMS; i++) {
+		work_init(&wqitems[i], workfunc, (void *)(uintptr_t)i);
+		wqruns[i] = 0;
+	}
+
+	/*
+	 * A burst of work. With interrupts off our cpu's worker can't
+	 * get in until we're done, so it should all go in one batch,
+	 * and queueing each item a second time should be refused.
+	 */
+	spl = splhigh();
+	wq = &curcpu->c_workq;
+	batches = wq->wq_batches;
+	items = wq->wq_items;
+	for (i=0; i<NITEMS; i++) {
+		if (!workqueue_enqueue(&wqitems[i])) {
+			kprintf("wqtest: enqueue of idle item %u refused\n", i);
+			wqfailed = true;
+		}
+		if (workqueue_enqueue(&wqitems[i])) {
+			kprintf("wqtest: pending item %u queued twice\n", i);
+			wqfailed = true;
+		}
+	}
+	splx(spl);
+	for (i=0; i<NITEMS; i++) {
+		P(wqsem);
+	}
+	for (i=0; i<NITEMS; i++) {
+		checkruns("burst", i, 1);
+	}
+	kprintf("wqtest: %u items ran in %u batch(es)\n",
+		wq->wq_items - items, wq->wq_batches - batches);
+
+	/* Delayed work shouldn't run early. */
+	gettime(&before);
+	workqueue_enqueue_delayed(&wqitems[1], timer_mstoticks(DELAY_MSECS));
+	P(wqsem);
+	gettime(&after);
+	timespec_sub(&after, &before, &diff);
+	msecs = diff.tv_sec * 1000 + diff.tv_nsec / 1000000;
+	if (msecs < DELAY_MSECS) {
+		kprintf("wqtest: delayed work ran after %u ms, expected %u\n",
+			msecs, DELAY_MSECS);
+		wqfailed = true;
+	}
+	checkruns("delayed", 1, 2);
+
+	/* Cancelled delayed work shouldn't run at all. */
+	workqueue_enqueue_delayed(&wqitems[2], timer_mstoticks(DELAY_MSECS));
+	if (!workqueue_cancel(&wqitems[2])) {
+		kprintf("wqtest: couldn't cancel delayed work\n");
+		wqfailed = true;
+	}
+	if (workqueue_cancel(&wqitems[2])) {
+		kprintf("wqtest: cancelled delayed work twice\n");
+		wqfailed = true;
+	}
+	timer_sleep(timer_mstoticks(DELAY_MSECS * 2));
+	checkruns("cancelled", 2, 1);
+
+	/* Work queued from an interrupt handler. */
+	timer_init(&tm, timerfunc, NULL);
+	timer_add(&tm, 1);
+	P(wqsem);
+	checkruns("from interrupt", 0, 2);
+
+	kprintf("Workqueue test %s.\n", wqfailed ? "FAILED" : "done");
+	return 0;
+}
@@ -32,6 +32,10 @@
 #include <cpu.h>
 #include <wchan.h>
 #include <clock.h>
+#include <timer.h>
+#include <rcu.h>
+#include <counter.h>
+#include <mainbus.h>
 #include <thread.h>
 #include <current.h>
 
@@ -50,8 +54,18 @@
  * Timing constants. These should be tuned along with any work done on
  * the scheduler.
  */
-#define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
-#define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define SCHEDULE_HARDCLOCKS	(HZ/2)	/* Boost priorities twice a second. */
+#define MIGRATE_HARDCLOCKS	16	/* Rebalance every 16 hardclocks. */
+
+/*
+ * Longest an idle cpu goes without a hardclock. This is kept to the
+ * rebalancing interval so idle cpus still go looking for work to
+ * steal (see thread_switch).
+ */
+#define TICKLESS_HARDCLOCKS	MIGRATE_HARDCLOCKS
+
+/* Set to stop the hardclock on idle cpus. */
+bool hardclock_tickless = false;
 
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
@@ -92,18 +106,90 @@ timerclock(void)
 void
 hardclock(void)
 {
+	unsigned ticks;
+
 	/*
 	 * Collect statistics here as desired.
 	 */
 
-	curcpu->c_hardclocks++;
-	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
+	counter_inc(CNT_HARDCLOCKS);
+	ticks = counter_get(curcpu->c_self, CNT_HARDCLOCKS);
+	/* Interrupts are on, so we didn't interrupt an RCU reader. */
+	rcu_quiescent();
+	timerwheel_tick();
+	if ((ticks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
-	if ((curcpu->c_hardclocks % SCHEDULE_HARDCLOCKS) == 0) {
+	if ((ticks % SCHEDULE_HARDCLOCKS) == 0) {
 		schedule();
 	}
-	thread_yield();
+	if (thread_tick()) {
+		thread_yield();
+	}
+}
+
+/*
+ * Called by the idle loop, with interrupts off, just before idling.
+ * If nothing is due for a while, stop the periodic hardclock and
+ * arrange to be interrupted when something is.
+ *
+ * Timers added to this cpu's wheel from elsewhere in the meantime
+ * (which only happens if the adding thread got moved mid-add) may
+ * go off up to TICKLESS_HARDCLOCKS late.
+ */
+void
+hardclock_idle(void)
+{
+	unsigned ticks;
+
+	if (!hardclock_tickless || curcpu->c_tickless) {
+		return;
+	}
+
+	ticks = timerwheel_idleticks(&curcpu->c_timers, TICKLESS_HARDCLOCKS);
+	if (ticks <= 1) {
+		/* The next hardclock is needed anyway. */
+		return;
+	}
+
+	curcpu->c_tickless = true;
+	mainbus_timer_oneshot(ticks);
+}
+
+/*
+ * Called on every interrupt, with interrupts off. If the periodic
+ * hardclock was stopped, restart it and account for the hardclocks
+ * we skipped: advance the hardclock count and the timer wheel by
+ * that many ticks.
+ */
+bool
+hardclock_resume(bool timerfired)
+{
+	unsigned elapsed;
+
+	if (!curcpu->c_tickless) {
+		return false;
+	}
+	curcpu->c_tickless = false;
+
+	elapsed = mainbus_timer_periodic(timerfired);
+	if (timerfired) {
+		/* The one-shot interrupt itself isn't an avoided tick. */
+		if (elapsed == 0) {
+			elapsed = 1;
+		}
+		counter_add(CNT_TICKS_AVOIDED, elapsed - 1);
+	}
+	else {
+		counter_add(CNT_TICKS_AVOIDED, elapsed);
+	}
+
+	while (elapsed > 0) {
+		counter_inc(CNT_HARDCLOCKS);
+		timerwheel_tick();
+		elapsed--;
+	}
+	return true;
 }
 
 /*
@@ -0,0 +1,91 @@
+/*
+ * Per-cpu event counters.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <cpu.h>
+#include <current.h>
+#include <counter.h>
+
+static const char *const counter_names[CNT_NUM] = {
+	[CNT_HARDCLOCKS] = "hardclocks",
+	[CNT_TICKS_AVOIDED] = "ticks avoided",
+	[CNT_SWITCHES] = "switches",
+	[CNT_MIGRATIONS] = "migrations",
+	[CNT_WAKEUPS_AFFINE] = "affine wakeups",
+	[CNT_WAKEUPS_IDLE] = "idle wakeups",
+	[CNT_SYSCALLS] = "syscalls",
+	[CNT_KMALLOC] = "kmalloc",
+	[CNT_KMALLOC_PAGES] = "kmalloc pages",
+	[CNT_KMALLOC_FAILED] = "kmalloc failed",
+	[CNT_KFREE] = "kfree",
+};
+
+void
+counter_add(enum counter cnt, uint64_t n)
+{
+	int spl;
+
+	KASSERT(cnt < CNT_NUM);
+
+	/* kmalloc is called before there's a cpu to count on. */
+	if (!CURCPU_EXISTS()) {
+		return;
+	}
+
+	spl = splhigh();
+	curcpu->c_counters[cnt] += n;
+	splx(spl);
+}
+
+void
+counter_inc(enum counter cnt)
+{
+	counter_add(cnt, 1);
+}
+
+uint64_t
+counter_get(const struct cpu *c, enum counter cnt)
+{
+	KASSERT(cnt < CNT_NUM);
+	return c->c_counters[cnt];
+}
+
+uint64_t
+counter_sum(enum counter cnt)
+{
+	uint64_t total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<cpu_count(); i++) {
+		total += counter_get(cpu_get(i), cnt);
+	}
+	return total;
+}
+
+const char *
+counter_name(enum counter cnt)
+{
+	KASSERT(cnt < CNT_NUM);
+	return counter_names[cnt];
+}
+
+void
+counter_printall(void)
+{
+	unsigned i, j;
+
+	for (i=0; i<CNT_NUM; i++) {
+		kprintf("%-16s %10llu  (", counter_name(i),
+			(unsigned long long)counter_sum(i));
+		for (j=0; j<cpu_count(); j++) {
+			kprintf("%s%llu", j > 0 ? " " : "",
+				(unsigned long long)
+				counter_get(cpu_get(j), i));
+		}
+		kprintf(")\n");
+	}
+}
@@ -0,0 +1,245 @@
+/*
+ * Lock contention statistics. See <lockstat.h>.
+ *
+ * Records live in a fixed open-hashed table and are never freed, so
+ * locks can keep pointers to them. The table, and each record's
+ * counters, are guarded by bare test-and-set words rather than struct
+ * spinlocks, because spinlocks call in here. The table lock is only
+ * taken to find or add a record, and to reset or print them all;
+ * counting takes just the record's own word, so unrelated locks don't
+ * meet in here.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+#define LOCKSTAT_SLOTS	256
+
+/* How many records to print. */
+#define LOCKSTAT_SHOW	40
+
+static struct lockstat lockstat_table[LOCKSTAT_SLOTS];
+static volatile spinlock_data_t lockstat_tablelock = SPINLOCK_DATA_INITIALIZER;
+static bool lockstat_enabled;
+
+static
+int
+lockstat_lockword(volatile spinlock_data_t *word)
+{
+	int spl;
+
+	/* Interrupt handlers take spinlocks, which may come here. */
+	spl = splhigh();
+	while (spinlock_data_testandset(word) != 0) {
+		/* spin */
+	}
+	membar_store_any();
+	return spl;
+}
+
+static
+void
+lockstat_unlockword(volatile spinlock_data_t *word, int spl)
+{
+	membar_any_store();
+	spinlock_data_set(word, 0);
+	splx(spl);
+}
+
+static
+int
+lockstat_locktable(void)
+{
+	return lockstat_lockword(&lockstat_tablelock);
+}
+
+static
+void
+lockstat_unlocktable(int spl)
+{
+	lockstat_unlockword(&lockstat_tablelock, spl);
+}
+
+static
+unsigned
+lockstat_hash(const char *name)
+{
+	unsigned h = 0;
+
+	while (*name) {
+		h = h * 33 + (unsigned char)*name++;
+	}
+	return h;
+}
+
+struct lockstat *
+lockstat_get(const char *name, bool spin)
+{
+	char key[LOCKSTAT_NAMELEN];
+	struct lockstat *ls, *ret;
+	unsigned i, slot;
+	int spl;
+
+	/* Names are matched as they'll be stored: truncated. */
+	snprintf(key, sizeof(key), "%s", name[0] ? name : "(unnamed)");
+
+	ret = NULL;
+	slot = lockstat_hash(key) % LOCKSTAT_SLOTS;
+	spl = lockstat_locktable();
+	for (i=0; i<LOCKSTAT_SLOTS; i++) {
+		ls = &lockstat_table[(slot + i) % LOCKSTAT_SLOTS];
+		if (ls->ls_name[0] == '\0') {
+			strcpy(ls->ls_name, key);
+			ls->ls_spin = spin;
+			ret = ls;
+			break;
+		}
+		if (ls->ls_spin == spin && !strcmp(ls->ls_name, key)) {
+			ret = ls;
+			break;
+		}
+	}
+	lockstat_unlocktable(spl);
+	return ret;
+}
+
+struct lockstat *
+lockstat_getspin(const void *key)
+{
+	char name[LOCKSTAT_NAMELEN];
+
+	if (!lockstat_enabled) {
+		return NULL;
+	}
+	snprintf(name, sizeof(name), "%p", key);
+	return lockstat_get(name, true);
+}
+
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+
+	if (!lockstat_enabled) {
+		return 0;
+	}
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t
+lockstat_acquired(struct lockstat *ls, uint64_t waitstart)
+{
+	uint64_t now;
+	int spl;
+
+	if (ls == NULL || !lockstat_enabled) {
+		return 0;
+	}
+	now = lockstat_now();
+	spl = lockstat_lockword(&ls->ls_lock);
+	ls->ls_acquires++;
+	if (waitstart != 0) {
+		ls->ls_contended++;
+		ls->ls_waitns += now - waitstart;
+	}
+	lockstat_unlockword(&ls->ls_lock, spl);
+	return now;
+}
+
+void
+lockstat_released(struct lockstat *ls, uint64_t holdstart)
+{
+	uint64_t held;
+	int spl;
+
+	if (ls == NULL || holdstart == 0) {
+		return;
+	}
+	held = lockstat_now() - holdstart;
+	spl = lockstat_lockword(&ls->ls_lock);
+	if (held > ls->ls_maxholdns) {
+		ls->ls_maxholdns = held;
+	}
+	lockstat_unlockword(&ls->ls_lock, spl);
+}
+
+void
+lockstat_start(void)
+{
+	lockstat_enabled = true;
+}
+
+void
+lockstat_reset(void)
+{
+	struct lockstat *ls;
+	unsigned i;
+	int spl, spl2;
+
+	spl = lockstat_locktable();
+	for (i=0; i<LOCKSTAT_SLOTS; i++) {
+		ls = &lockstat_table[i];
+		spl2 = lockstat_lockword(&ls->ls_lock);
+		ls->ls_acquires = 0;
+		ls->ls_contended = 0;
+		ls->ls_waitns = 0;
+		ls->ls_maxholdns = 0;
+		lockstat_unlockword(&ls->ls_lock, spl2);
+	}
+	lockstat_unlocktable(spl);
+}
+
+void
+lockstat_print(void)
+{
+	struct lockstat *ls, *copy, tmp;
+	unsigned i, j, n;
+	int spl, spl2;
+
+	/* Take a snapshot, so as not to print with the table locked. */
+	copy = kmalloc(sizeof(*copy) * LOCKSTAT_SLOTS);
+	if (copy == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+	n = 0;
+	spl = lockstat_locktable();
+	for (i=0; i<LOCKSTAT_SLOTS; i++) {
+		ls = &lockstat_table[i];
+		spl2 = lockstat_lockword(&ls->ls_lock);
+		if (ls->ls_acquires > 0) {
+			copy[n++] = *ls;
+		}
+		lockstat_unlockword(&ls->ls_lock, spl2);
+	}
+	lockstat_unlocktable(spl);
+
+	/* Insertion sort, most time waited first. */
+	for (i=1; i<n; i++) {
+		tmp = copy[i];
+		for (j=i; j>0 && copy[j-1].ls_waitns < tmp.ls_waitns; j--) {
+			copy[j] = copy[j-1];
+		}
+		copy[j] = tmp;
+	}
+
+	kprintf("%-24s %4s %10s %10s %12s %10s\n", "lock", "kind",
+		"acquires", "contended", "wait(us)", "maxhold(us)");
+	for (i=0; i<n && i<LOCKSTAT_SHOW; i++) {
+		kprintf("%-24s %4s %10u %10u %12u %10u\n",
+			copy[i].ls_name, copy[i].ls_spin ? "spin" : "lock",
+			copy[i].ls_acquires, copy[i].ls_contended,
+			(unsigned)(copy[i].ls_waitns / 1000),
+			(unsigned)(copy[i].ls_maxholdns / 1000));
+	}
+	if (n > LOCKSTAT_SHOW) {
+		kprintf("(%u more)\n", n - LOCKSTAT_SHOW);
+	}
+	kfree(copy);
+}
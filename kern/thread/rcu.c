@@ -0,0 +1,161 @@
+/*
+ * Read-copy-update grace periods and deferred reclamation.
+ *
+ * Each cpu counts the quiescent states it passes through in
+ * c_rcu_qs. To start a grace period we snapshot every cpu's count
+ * into c_rcu_snap; the grace period is over when every cpu's count
+ * has moved on or the cpu is idle. (An idle cpu, even a tickless one
+ * that isn't counting, is in a quiescent state right now, and can't be
+ * in the middle of a read that started earlier.) Idle here means
+ * c_rcu_idle, which is set only while the cpu sits in cpu_idle and is
+ * cleared again on the way into any interrupt taken there, since the
+ * handler might be a reader; c_isidle stays set through those.
+ *
+ * Deferred items collect on rcu_next. When no grace period is running,
+ * the next batch moves to rcu_wait and one starts; when it ends, that
+ * batch is run. All of this is done by a work item that re-queues
+ * itself a tick later for as long as there's anything waiting, so
+ * nothing happens at all while nothing is deferred.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <cpu.h>
+#include <current.h>
+#include <workqueue.h>
+#include <rcu.h>
+
+static struct spinlock rcu_lock = SPINLOCK_INITIALIZER;
+static struct rcu_head *rcu_next;	/* deferred, no grace period yet */
+static struct rcu_head *rcu_wait;	/* waiting on the current one */
+static struct work rcu_work;
+
+int
+rcu_read_lock(void)
+{
+	return splhigh();
+}
+
+void
+rcu_read_unlock(int spl)
+{
+	splx(spl);
+}
+
+/*
+ * Called by thread_switch and hardclock. Neither can happen inside a
+ * read-side section on this cpu.
+ */
+void
+rcu_quiescent(void)
+{
+	curcpu->c_rcu_qs++;
+}
+
+/*
+ * Called around cpu_idle in the idle loop, and on interrupt entry.
+ */
+void
+rcu_idle_enter(void)
+{
+	curcpu->c_rcu_idle = true;
+}
+
+void
+rcu_idle_exit(void)
+{
+	curcpu->c_rcu_idle = false;
+}
+
+/*
+ * Start a grace period. rcu_lock must be held.
+ */
+static
+void
+rcu_gpstart(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		c->c_rcu_snap = c->c_rcu_qs;
+	}
+}
+
+/*
+ * Check if the current grace period is over. rcu_lock must be held.
+ * c_rcu_qs and c_rcu_idle belong to other cpus; reading them unlocked
+ * is fine, since either can only make us wait another round.
+ */
+static
+bool
+rcu_gpdone(void)
+{
+	struct cpu *c;
+	unsigned i;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		if (c->c_rcu_qs == c->c_rcu_snap && !c->c_rcu_idle) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static
+void
+rcu_process(void *data)
+{
+	struct rcu_head *done, *rh, *next;
+	bool more;
+
+	(void)data;
+
+	done = NULL;
+	spinlock_acquire(&rcu_lock);
+	if (rcu_wait != NULL && rcu_gpdone()) {
+		done = rcu_wait;
+		rcu_wait = NULL;
+	}
+	if (rcu_wait == NULL && rcu_next != NULL) {
+		rcu_wait = rcu_next;
+		rcu_next = NULL;
+		rcu_gpstart();
+	}
+	more = (rcu_wait != NULL);
+	spinlock_release(&rcu_lock);
+
+	for (rh = done; rh != NULL; rh = next) {
+		next = rh->rh_next;
+		rh->rh_func(rh->rh_data);
+	}
+
+	if (more) {
+		workqueue_enqueue_delayed(&rcu_work, 1);
+	}
+}
+
+void
+rcu_defer(struct rcu_head *rh, void (*func)(void *), void *data)
+{
+	rh->rh_func = func;
+	rh->rh_data = data;
+
+	spinlock_acquire(&rcu_lock);
+	rh->rh_next = rcu_next;
+	rcu_next = rh;
+	spinlock_release(&rcu_lock);
+
+	/* If it's already pending, it'll pick this up. */
+	workqueue_enqueue_delayed(&rcu_work, 1);
+}
+
+void
+rcu_bootstrap(void)
+{
+	work_init(&rcu_work, rcu_process, NULL);
+}
@@ -38,11 +38,20 @@
 #include <spinlock.h>
 #include <membar.h>
 #include <current.h>	/* for curcpu */
+#include <lockstat.h>
 
 /*
  * Spinlocks.
  */
 
+/*
+ * Backoff: while waiting, a CPU rereads the lock about once per this
+ * many loop iterations for each CPU ahead of it in line. Each CPU in
+ * front will hold the lock for a while, so there's no point looking
+ * sooner, and every read of the lock word while it's being handed
+ * over is bus traffic that slows the handover down.
+ */
+#define SPINLOCK_BACKOFF	16
 
 /*
  * Initialize spinlock.
@@ -50,8 +59,14 @@
 void
 spinlock_init(struct spinlock *splk)
 {
-	spinlock_data_set(&splk->splk_lock, 0);
+	spinlock_data_set(&splk->splk_next, 0);
+	spinlock_data_set(&splk->splk_serving, 0);
 	splk->splk_holder = NULL;
+#if OPT_LOCKSTAT
+	splk->splk_site = __builtin_return_address(0);
+	splk->splk_stat = NULL;
+	splk->splk_holdstart = 0;
+#endif
 }
 
 /*
@@ -61,20 +76,26 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
-	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+	KASSERT(spinlock_data_get(&splk->splk_next) ==
+		spinlock_data_get(&splk->splk_serving));
 }
 
 /*
  * Get the lock.
  *
  * First disable interrupts (otherwise, if we get a timer interrupt we
- * might come back to this lock and deadlock), then use a machine-level
- * atomic operation to wait for the lock to be free.
+ * might come back to this lock and deadlock), then take a ticket and
+ * wait for our turn.
  */
 void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+	spinlock_data_t ticket, serving;
+	volatile unsigned delay;
+#if OPT_LOCKSTAT
+	uint64_t waitstart;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -90,28 +111,38 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+	/*
+	 * Taking a ticket is the only atomic operation; after that we
+	 * only read. Wraparound of the ticket counters is harmless as
+	 * long as there are fewer than 2^32 CPUs waiting.
+	 */
+	ticket = spinlock_data_fetchadd(&splk->splk_next, 1);
+#if OPT_LOCKSTAT
+	waitstart = 0;
+	if (spinlock_data_get(&splk->splk_serving) != ticket) {
+		waitstart = lockstat_now();
+	}
+#endif
 	while (1) {
-		/*
-		 * Do test-test-and-set, that is, read first before
-		 * doing test-and-set, to reduce bus contention.
-		 *
-		 * Test-and-set is a machine-level atomic operation
-		 * that writes 1 into the lock word and returns the
-		 * previous value. If that value was 0, the lock was
-		 * previously unheld and we now own it. If it was 1,
-		 * we don't.
-		 */
-		if (spinlock_data_get(&splk->splk_lock) != 0) {
-			continue;
+		serving = spinlock_data_get(&splk->splk_serving);
+		if (serving == ticket) {
+			break;
 		}
-		if (spinlock_data_testandset(&splk->splk_lock) != 0) {
-			continue;
+		for (delay = (ticket - serving) * SPINLOCK_BACKOFF;
+		     delay > 0; delay--) {
+			/* nothing */
 		}
-		break;
 	}
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
+#if OPT_LOCKSTAT
+	if (splk->splk_stat == NULL) {
+		splk->splk_stat = lockstat_getspin(splk->splk_site != NULL ?
+						   splk->splk_site : splk);
+	}
+	splk->splk_holdstart = lockstat_acquired(splk->splk_stat, waitstart);
+#endif
 }
 
 /*
@@ -127,9 +158,15 @@ spinlock_release(struct spinlock *splk)
 		curcpu->c_spinlocks--;
 	}
 
+#if OPT_LOCKSTAT
+	lockstat_released(splk->splk_stat, splk->splk_holdstart);
+	splk->splk_holdstart = 0;
+#endif
 	splk->splk_holder = NULL;
 	membar_any_store();
-	spinlock_data_set(&splk->splk_lock, 0);
+	/* Only the holder writes splk_serving, so no atomic op needed. */
+	spinlock_data_set(&splk->splk_serving,
+			  spinlock_data_get(&splk->splk_serving) + 1);
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
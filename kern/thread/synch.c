@@ -33,17 +33,41 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <timer.h>
+#include <cpu.h>
 #include <thread.h>
 #include <current.h>
 #include <synch.h>
+#include <lockstat.h>
+
+/*
+ * Adaptive locks: how many times to look at a lock whose holder is
+ * running on another cpu before giving up and sleeping.
+ */
+#define LOCK_SPIN_MAX	1000
+
+bool lock_spinning = true;
 
 ////////////////////////////////////////////////////////////
 //
 // Semaphore.
 
+/*
+ * A thread waiting on a handoff semaphore. It lives on the waiter's
+ * stack and is linked into sem_head, oldest first; V takes the first
+ * one off the list and sets sw_granted, so the unit belongs to that
+ * thread alone and nobody else can take it before it runs.
+ */
+struct sem_waiter {
+	struct thread *sw_thread;
+	bool sw_granted;
+	struct sem_waiter *sw_next;
+};
+
 struct semaphore *
 sem_create(const char *name, unsigned initial_count)
 {
@@ -69,7 +93,23 @@ sem_create(const char *name, unsigned initial_count)
 
 	spinlock_init(&sem->sem_lock);
 	sem->sem_count = initial_count;
+	sem->sem_fifo = false;
+	sem->sem_head = NULL;
+	sem->sem_tailp = &sem->sem_head;
+	sem->sem_nwaiting = 0;
+
+	return sem;
+}
+
+struct semaphore *
+sem_create_fifo(const char *name, unsigned initial_count)
+{
+	struct semaphore *sem;
 
+	sem = sem_create(name, initial_count);
+	if (sem != NULL) {
+		sem->sem_fifo = true;
+	}
 	return sem;
 }
 
@@ -79,15 +119,57 @@ sem_destroy(struct semaphore *sem)
 	KASSERT(sem != NULL);
 
 	/* wchan_cleanup will assert if anyone's waiting on it */
+	KASSERT(sem->sem_head == NULL);
 	spinlock_cleanup(&sem->sem_lock);
 	wchan_destroy(sem->sem_wchan);
 	kfree(sem->sem_name);
 	kfree(sem);
 }
 
+/*
+ * Handoff mode: get in line at the tail. sem_lock must be held.
+ */
+static
+void
+sem_enqueue(struct semaphore *sem, struct sem_waiter *sw)
+{
+	KASSERT(spinlock_do_i_hold(&sem->sem_lock));
+
+	sw->sw_thread = curthread;
+	sw->sw_granted = false;
+	sw->sw_next = NULL;
+	*sem->sem_tailp = sw;
+	sem->sem_tailp = &sw->sw_next;
+	sem->sem_nwaiting++;
+}
+
+/*
+ * Handoff mode: leave the line without having been given a unit.
+ * sem_lock must be held.
+ */
+static
+void
+sem_unlink(struct semaphore *sem, struct sem_waiter *sw)
+{
+	struct sem_waiter **swp;
+
+	KASSERT(spinlock_do_i_hold(&sem->sem_lock));
+
+	for (swp = &sem->sem_head; *swp != sw; swp = &(*swp)->sw_next) {
+		KASSERT(*swp != NULL);
+	}
+	*swp = sw->sw_next;
+	if (sem->sem_tailp == &sw->sw_next) {
+		sem->sem_tailp = swp;
+	}
+	sem->sem_nwaiting--;
+}
+
 void
 P(struct semaphore *sem)
 {
+	struct sem_waiter sw;
+
 	KASSERT(sem != NULL);
 
 	/*
@@ -100,6 +182,19 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_fifo && sem->sem_count == 0) {
+		/*
+		 * Handoff mode. The count can only be nonzero when
+		 * nobody is waiting, so if it's zero get in line and
+		 * wait for V to give us a unit of our own.
+		 */
+		sem_enqueue(sem, &sw);
+		while (!sw.sw_granted) {
+			wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+		}
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
 	while (sem->sem_count == 0) {
 		/*
 		 *
@@ -111,7 +206,7 @@ P(struct semaphore *sem)
 		 * strict ordering. Too bad. :-)
 		 *
 		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * ordering? (Answer: see the handoff mode above.)
 		 */
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
 	}
@@ -120,13 +215,80 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+int
+P_timed(struct semaphore *sem, unsigned msecs)
+{
+	struct sem_waiter sw;
+	struct timedwait td;
+	int result;
+
+	KASSERT(sem != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	/* The timer must be armed before taking the semaphore spinlock. */
+	timedwait_start(&td, sem->sem_wchan, &sem->sem_lock,
+			timer_mstoticks(msecs));
+
+	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_fifo && sem->sem_count == 0) {
+		/* As in P. */
+		sem_enqueue(sem, &sw);
+		while (!sw.sw_granted && !td.td_expired) {
+			wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+		}
+		if (sw.sw_granted) {
+			/* Even if the time also ran out; it's ours. */
+			result = 0;
+		}
+		else {
+			/* Timed out; leave the line. */
+			sem_unlink(sem, &sw);
+			result = ETIMEDOUT;
+		}
+	}
+	else {
+		while (sem->sem_count == 0 && !td.td_expired) {
+			wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+		}
+		if (sem->sem_count > 0) {
+			sem->sem_count--;
+			result = 0;
+		}
+		else {
+			result = ETIMEDOUT;
+		}
+	}
+	spinlock_release(&sem->sem_lock);
+
+	timedwait_finish(&td);
+	return result;
+}
+
 void
 V(struct semaphore *sem)
 {
+	struct sem_waiter *sw;
+
 	KASSERT(sem != NULL);
 
 	spinlock_acquire(&sem->sem_lock);
 
+	if (sem->sem_fifo && sem->sem_head != NULL) {
+		/* Hand it straight to the oldest waiter. */
+		sw = sem->sem_head;
+		sem->sem_head = sw->sw_next;
+		if (sem->sem_head == NULL) {
+			sem->sem_tailp = &sem->sem_head;
+		}
+		sem->sem_nwaiting--;
+		sw->sw_granted = true;
+		/* Not asleep if a timeout already woke it; it'll see this */
+		wchan_wakethread(sem->sem_wchan, &sem->sem_lock,
+				 sw->sw_thread);
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
+
 	sem->sem_count++;
 	KASSERT(sem->sem_count > 0);
 	wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
@@ -142,6 +304,7 @@ struct lock *
 lock_create(const char *name)
 {
 	struct lock *lock;
+	unsigned i;
 
 	lock = kmalloc(sizeof(struct lock));
 	if (lock == NULL) {
@@ -162,6 +325,15 @@ lock_create(const char *name)
 	}
 	spinlock_init(&lock->lk_lock);
 	lock->lk_holder = NULL;
+	lock->lk_nextheld = NULL;
+	lock->lk_nwaiters = 0;
+	for (i=0; i<THREAD_NPRIO; i++) {
+		lock->lk_waiters[i] = 0;
+	}
+#if OPT_LOCKSTAT
+	lock->lk_stat = lockstat_get(lock->lk_name, false);
+	lock->lk_holdstart = 0;
+#endif
 
 	return lock;
 }
@@ -172,6 +344,7 @@ lock_destroy(struct lock *lock)
 	KASSERT(lock != NULL);
 
 	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_nwaiters == 0);
 	spinlock_cleanup(&lock->lk_lock);
 	wchan_destroy(lock->lk_wchan);
 
@@ -179,6 +352,260 @@ lock_destroy(struct lock *lock)
 	kfree(lock);
 }
 
+/*
+ * Priority inheritance.
+ *
+ * A thread that has to sleep waiting for a lock lends its priority to
+ * the holder, and if the holder is itself waiting for a lock, on down
+ * that chain too; otherwise a low-priority holder that can't get the
+ * cpu keeps a high-priority thread waiting indefinitely. Each lock
+ * counts its sleeping waiters by the level they were at, and each
+ * thread keeps a list of the locks it holds, so that when it releases
+ * one its boost can drop back to the best level still waiting on the
+ * rest.
+ *
+ * lock_pilock protects lk_waiters, t_waitlock, t_waitprio and the
+ * lending of priorities. It nests inside lk_lock and outside the run
+ * queue locks. lk_nwaiters is only changed holding both lk_lock and
+ * lock_pilock, so lock_release can tell from it whether it needs
+ * lock_pilock at all; when nobody is waiting, locks never touch it.
+ * This also means a holder that a chain walk finds can't release the
+ * lock and go away under it, since that lock has a waiter.
+ */
+
+/* Deeper than this is almost certainly a deadlock anyway. */
+#define LOCK_PI_MAXDEPTH	8
+
+static struct spinlock lock_pilock = SPINLOCK_INITIALIZER;
+
+/*
+ * Best level waiting for LOCK, or THREAD_NPRIO if none.
+ */
+static
+unsigned
+lock_topwaiter(struct lock *lock)
+{
+	unsigned i;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	for (i=0; i<THREAD_NPRIO; i++) {
+		if (lock->lk_waiters[i] > 0) {
+			break;
+		}
+	}
+	return i;
+}
+
+/*
+ * Lend level PRIO to LOCK's holder, and to the holder of whatever lock
+ * that thread is waiting for, and so on, until we get to a thread
+ * that's already doing at least as well.
+ */
+static
+void
+lock_lend(struct lock *lock, unsigned prio)
+{
+	struct thread *holder;
+	struct lock *next;
+	unsigned depth;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	for (depth = 0; depth < LOCK_PI_MAXDEPTH; depth++) {
+		holder = lock->lk_holder;
+		if (holder == NULL || thread_effpriority(holder) <= prio) {
+			break;
+		}
+		thread_setboost(holder, prio);
+
+		next = holder->t_waitlock;
+		if (next == NULL) {
+			break;
+		}
+		/* It's counted at its old level there; move it up. */
+		next->lk_waiters[holder->t_waitprio]--;
+		next->lk_waiters[prio]++;
+		holder->t_waitprio = prio;
+		lock = next;
+	}
+}
+
+/*
+ * Set the current thread's boost to the best level waiting on any
+ * lock it still holds.
+ */
+static
+void
+lock_reboost(void)
+{
+	struct lock *held;
+	unsigned best, top;
+
+	KASSERT(spinlock_do_i_hold(&lock_pilock));
+
+	best = THREAD_NPRIO;
+	for (held = curthread->t_heldlocks; held != NULL;
+	     held = held->lk_nextheld) {
+		top = lock_topwaiter(held);
+		if (top < best) {
+			best = top;
+		}
+	}
+	if (best != curthread->t_boost) {
+		thread_setboost(curthread, best);
+	}
+}
+
+/*
+ * Called with LOCK's lk_lock held around sleeping for it: count us as
+ * a waiter and lend out our priority, and afterwards stop.
+ */
+static
+void
+lock_wait_start(struct lock *lock)
+{
+	unsigned prio;
+
+	spinlock_acquire(&lock_pilock);
+	prio = thread_effpriority(curthread);
+	curthread->t_waitlock = lock;
+	curthread->t_waitprio = prio;
+	lock->lk_waiters[prio]++;
+	lock->lk_nwaiters++;
+	lock_lend(lock, prio);
+	spinlock_release(&lock_pilock);
+}
+
+static
+void
+lock_wait_done(struct lock *lock)
+{
+	spinlock_acquire(&lock_pilock);
+	KASSERT(curthread->t_waitlock == lock);
+	lock->lk_waiters[curthread->t_waitprio]--;
+	lock->lk_nwaiters--;
+	curthread->t_waitlock = NULL;
+	spinlock_release(&lock_pilock);
+}
+
+/*
+ * True if HOLDER is running on some other cpu, so is likely to release
+ * a short-held lock soon. This peeks at another thread's state without
+ * its run queue lock, so it's only a hint; and the holder may release
+ * the lock and exit while we look, but thread structures stay mapped
+ * (or cached for reuse) so the worst that happens is a wrong answer.
+ */
+static
+bool
+lock_holder_running(struct thread *holder)
+{
+	/* volatile, so spinning on this rereads it each time */
+	volatile struct thread *h = holder;
+
+	return h->t_state == S_RUN && h->t_cpu != curcpu->c_self;
+}
+
+/*
+ * The guts of lock_acquire and lock_release, called with lk_lock held.
+ * These are split out so the CV code, which keeps its wait channel
+ * under the lock's spinlock, can use them without another round trip
+ * on that spinlock. lock_acquire_locked may let go of lk_lock while it
+ * waits, but holds it again on return.
+ */
+static
+void
+lock_acquire_locked(struct lock *lock)
+{
+	struct thread *holder;
+	unsigned spins;
+	bool spun;
+#if OPT_LOCKSTAT
+	uint64_t waitstart;
+#endif
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+
+#if OPT_LOCKSTAT
+	waitstart = lock->lk_holder != NULL ? lockstat_now() : 0;
+#endif
+	spun = false;
+	while (lock->lk_holder != NULL) {
+		holder = lock->lk_holder;
+		if (lock_spinning && !spun && lock_holder_running(holder)) {
+			/*
+			 * The holder is busy on another cpu and will
+			 * probably be done soon; watch for that rather
+			 * than pay for two context switches. Let go of
+			 * the spinlock (and so our spl) while we wait,
+			 * so the holder can release and we can be
+			 * interrupted. If it takes too long, sleep.
+			 */
+			spinlock_release(&lock->lk_lock);
+			for (spins = 0; spins < LOCK_SPIN_MAX; spins++) {
+				if (lock->lk_holder != holder ||
+				    !lock_holder_running(holder)) {
+					break;
+				}
+			}
+			spun = (spins == LOCK_SPIN_MAX);
+			spinlock_acquire(&lock->lk_lock);
+			continue;
+		}
+		/* As in the semaphore. */
+		lock_wait_start(lock);
+		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+		lock_wait_done(lock);
+		spun = false;
+	}
+
+	lock->lk_holder = curthread;
+	lock->lk_nextheld = curthread->t_heldlocks;
+	curthread->t_heldlocks = lock;
+	if (lock->lk_nwaiters > 0) {
+		/* Whoever is still waiting lends us their priority. */
+		spinlock_acquire(&lock_pilock);
+		lock_reboost();
+		spinlock_release(&lock_pilock);
+	}
+#if OPT_LOCKSTAT
+	lock->lk_holdstart = lockstat_acquired(lock->lk_stat, waitstart);
+#endif
+}
+
+static
+void
+lock_release_locked(struct lock *lock)
+{
+	struct lock **heldp;
+
+	KASSERT(spinlock_do_i_hold(&lock->lk_lock));
+	KASSERT(lock->lk_holder == curthread);
+#if OPT_LOCKSTAT
+	lockstat_released(lock->lk_stat, lock->lk_holdstart);
+#endif
+
+	/* Usually it's the last one we took, but not necessarily. */
+	for (heldp = &curthread->t_heldlocks; *heldp != lock;
+	     heldp = &(*heldp)->lk_nextheld) {
+		KASSERT(*heldp != NULL);
+	}
+	*heldp = lock->lk_nextheld;
+	lock->lk_nextheld = NULL;
+
+	if (lock->lk_nwaiters > 0 || curthread->t_boost < THREAD_NPRIO) {
+		/* Give back what this lock's waiters lent us. */
+		spinlock_acquire(&lock_pilock);
+		lock->lk_holder = NULL;
+		lock_reboost();
+		spinlock_release(&lock_pilock);
+	}
+	else {
+		lock->lk_holder = NULL;
+	}
+	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+}
+
 void
 lock_acquire(struct lock *lock)
 {
@@ -190,12 +617,7 @@ lock_acquire(struct lock *lock)
 		spinlock_acquire(&lock->lk_lock);
 		return;
 	}
-	while (lock->lk_holder != NULL) {
-		/* As in the semaphore. */
-		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
-	}
-
-	lock->lk_holder = curthread;
+	lock_acquire_locked(lock);
 	spinlock_release(&lock->lk_lock);
 }
 
@@ -205,9 +627,7 @@ lock_release(struct lock *lock)
 	DEBUGASSERT(lock != NULL);
 
 	spinlock_acquire(&lock->lk_lock);
-	KASSERT(lock->lk_holder == curthread);
-	lock->lk_holder = NULL;
-	wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	lock_release_locked(lock);
 	spinlock_release(&lock->lk_lock);
 }
 
@@ -253,7 +673,6 @@ cv_create(const char *name)
 		return NULL;
 	}
 
-	spinlock_init(&cv->cv_wchanlock);
 	return cv;
 }
 
@@ -262,45 +681,234 @@ cv_destroy(struct cv *cv)
 {
 	KASSERT(cv != NULL);
 
-	spinlock_cleanup(&cv->cv_wchanlock);
 	wchan_destroy(cv->cv_wchan);
 
 	kfree(cv->cv_name);
 	kfree(cv);
 }
 
+/*
+ * The cv's wait channel is protected by the lock's spinlock, so going
+ * to sleep, dropping the lock, and getting it back again all happen
+ * under one spinlock, as do signal and broadcast. This is why a cv
+ * must always be used with the same lock.
+ */
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-	spinlock_acquire(&cv->cv_wchanlock);
-	lock_release(lock);
-	wchan_sleep(cv->cv_wchan, &cv->cv_wchanlock);
-	/*
-	 * It is kind of silly to acquire this spinlock in wchan_sleep
-	 * and then release it right away. If we were going for
-	 * performance we might pass a flag to avoid that in this
-	 * case. Or we might use lock->lk_lock to protect the wchan
-	 * and separate out enough of the lock_acquire/lock_release
-	 * logic to make that work cleanly.
-	 */
-	spinlock_release(&cv->cv_wchanlock);
-	lock_acquire(lock);
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(lock->lk_holder == curthread);
+
+	spinlock_acquire(&lock->lk_lock);
+	lock_release_locked(lock);
+	wchan_sleep(cv->cv_wchan, &lock->lk_lock);
+	lock_acquire_locked(lock);
+	spinlock_release(&lock->lk_lock);
+}
+
+int
+cv_timedwait(struct cv *cv, struct lock *lock, unsigned msecs)
+{
+	struct timedwait td;
+	bool expired;
+
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(lock->lk_holder == curthread);
+
+	/* As in P_timed, arm the timer before taking the spinlock. */
+	timedwait_start(&td, cv->cv_wchan, &lock->lk_lock,
+			timer_mstoticks(msecs));
+
+	spinlock_acquire(&lock->lk_lock);
+	lock_release_locked(lock);
+	if (!td.td_expired) {
+		wchan_sleep(cv->cv_wchan, &lock->lk_lock);
+	}
+	lock_acquire_locked(lock);
+	spinlock_release(&lock->lk_lock);
+
+	expired = timedwait_finish(&td);
+	return expired ? ETIMEDOUT : 0;
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeone(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	KASSERT(lock->lk_holder == curthread);
+
+	spinlock_acquire(&lock->lk_lock);
+	wchan_wakeone(cv->cv_wchan, &lock->lk_lock);
+	spinlock_release(&lock->lk_lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	(void)lock;
-	spinlock_acquire(&cv->cv_wchanlock);
-	wchan_wakeall(cv->cv_wchan, &cv->cv_wchanlock);
-	spinlock_release(&cv->cv_wchanlock);
+	KASSERT(lock->lk_holder == curthread);
+
+	spinlock_acquire(&lock->lk_lock);
+	wchan_wakeall(cv->cv_wchan, &lock->lk_lock);
+	spinlock_release(&lock->lk_lock);
+}
+
+////////////////////////////////////////////////////////////
+//
+// Reader-writer lock.
+//
+// Writers take a ticket and go in ticket order. Once a writer holds
+// or is waiting for the lock, new readers wait too, so readers can't
+// starve writers. When a writer releases the lock, all readers that
+// were waiting get it together (the releasing writer counts them in
+// rw_readers before waking them), ahead of the next writer; so a
+// stream of writers can't starve readers either.
+
+struct rwlock *
+rwlock_create(const char *name)
+{
+	struct rwlock *rw;
+
+	rw = kmalloc(sizeof(struct rwlock));
+	if (rw == NULL) {
+		return NULL;
+	}
+
+	rw->rw_name = kstrdup(name);
+	if (rw->rw_name == NULL) {
+		kfree(rw);
+		return NULL;
+	}
+
+	rw->rw_readwchan = wchan_create(rw->rw_name);
+	if (rw->rw_readwchan == NULL) {
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+	rw->rw_writewchan = wchan_create(rw->rw_name);
+	if (rw->rw_writewchan == NULL) {
+		wchan_destroy(rw->rw_readwchan);
+		kfree(rw->rw_name);
+		kfree(rw);
+		return NULL;
+	}
+	spinlock_init(&rw->rw_lock);
+	rw->rw_readers = 0;
+	rw->rw_readwaiting = 0;
+	rw->rw_readgen = 0;
+	rw->rw_writer = NULL;
+	rw->rw_nextticket = 0;
+	rw->rw_serving = 0;
+
+	return rw;
+}
+
+void
+rwlock_destroy(struct rwlock *rw)
+{
+	KASSERT(rw != NULL);
+
+	KASSERT(rw->rw_readers == 0);
+	KASSERT(rw->rw_writer == NULL);
+	KASSERT(rw->rw_nextticket == rw->rw_serving);
+	spinlock_cleanup(&rw->rw_lock);
+	wchan_destroy(rw->rw_writewchan);
+	wchan_destroy(rw->rw_readwchan);
+
+	kfree(rw->rw_name);
+	kfree(rw);
+}
+
+void
+rwlock_acquire_read(struct rwlock *rw)
+{
+	unsigned gen;
+
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	if (rw->rw_nextticket == rw->rw_serving) {
+		/* No writer in or waiting */
+		rw->rw_readers++;
+		spinlock_release(&rw->rw_lock);
+		return;
+	}
+
+	/* Wait for the next writer release to let us in. */
+	rw->rw_readwaiting++;
+	gen = rw->rw_readgen;
+	while (rw->rw_readgen == gen) {
+		wchan_sleep(rw->rw_readwchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_read(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_readers > 0);
+	rw->rw_readers--;
+	if (rw->rw_readers == 0 && rw->rw_nextticket != rw->rw_serving) {
+		/* Only the writer whose turn it is will go. */
+		wchan_wakeall(rw->rw_writewchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_acquire_write(struct rwlock *rw)
+{
+	unsigned ticket;
+
+	DEBUGASSERT(rw != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer != curthread);
+	ticket = rw->rw_nextticket++;
+	while (rw->rw_serving != ticket || rw->rw_writer != NULL ||
+	       rw->rw_readers > 0) {
+		wchan_sleep(rw->rw_writewchan, &rw->rw_lock);
+	}
+	rw->rw_writer = curthread;
+	spinlock_release(&rw->rw_lock);
+}
+
+void
+rwlock_release_write(struct rwlock *rw)
+{
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	KASSERT(rw->rw_writer == curthread);
+	rw->rw_writer = NULL;
+	rw->rw_serving++;
+	if (rw->rw_readwaiting > 0) {
+		/* Let in everyone who queued up behind us. */
+		rw->rw_readers += rw->rw_readwaiting;
+		rw->rw_readwaiting = 0;
+		rw->rw_readgen++;
+		wchan_wakeall(rw->rw_readwchan, &rw->rw_lock);
+	}
+	else if (rw->rw_nextticket != rw->rw_serving) {
+		wchan_wakeall(rw->rw_writewchan, &rw->rw_lock);
+	}
+	spinlock_release(&rw->rw_lock);
+}
+
+bool
+rwlock_do_i_hold_write(struct rwlock *rw)
+{
+	bool ret;
+
+	DEBUGASSERT(rw != NULL);
+
+	spinlock_acquire(&rw->rw_lock);
+	ret = (rw->rw_writer == curthread);
+	spinlock_release(&rw->rw_lock);
+
+	return ret;
 }
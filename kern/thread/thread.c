@@ -41,6 +41,11 @@
 #include <spl.h>
 #include <spinlock.h>
 #include <wchan.h>
+#include <timer.h>
+#include <workqueue.h>
+#include <rcu.h>
+#include <counter.h>
+#include <clock.h>
 #include <thread.h>
 #include <threadlist.h>
 #include <threadprivate.h>
@@ -57,6 +62,26 @@
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/*
+ * Scheduler quantum, in hardclocks, for a thread at priority level
+ * PRIO. Lower priority levels get longer (but rarer) time slices.
+ */
+#define THREAD_QUANTUM(prio) (1U << (prio))
+
+/*
+ * A thread that slept for fewer than this many hardclocks (of its
+ * last cpu) is woken on that cpu even if it's busy, on the theory
+ * that its cache footprint is still there. Otherwise we prefer an
+ * idle cpu so it can run right away.
+ */
+#define WAKEUP_AFFINE_HARDCLOCKS 2
+
+/*
+ * Maximum number of exited threads, with their stacks, each cpu keeps
+ * around for thread_fork to reuse.
+ */
+#define THREAD_CACHE_MAX 8
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -64,6 +89,9 @@ struct wchan {
 	unsigned wc_index;		/* index into allwchans[] */
 };
 
+/* Set once scheduling events can be timestamped. */
+static bool schedstats_enabled;
+
 /* Master array of CPUs. */
 DECLARRAY(cpu, static __UNUSED inline);
 DEFARRAY(cpu, static __UNUSED inline);
@@ -78,6 +106,16 @@ static struct wchanarray allwchans;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Work stealing, used by thread_switch; see below. */
+static struct thread *thread_steal_idle(void);
+
+/* Choosing a cpu for a thread; see below. */
+static struct cpu *thread_find_leastloaded(unsigned mask);
+
+/* Used by thread_checkaffinity to move threads between cpus. */
+static struct wchan *thread_move_wchan;
+static struct spinlock thread_move_lock;
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -117,6 +155,46 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize the fields of a thread, other than the name and the
+ * stack. This is used both for freshly allocated threads and for
+ * recycled ones.
+ */
+static
+void
+thread_init(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+	thread->t_wchan = NULL;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+	thread->t_cpumask = CPUMASK_ALL;
+
+	/* Scheduler fields; new threads start at the top */
+	thread->t_priority = THREAD_PRIO_MAX;
+	thread->t_ticks = 0;
+	thread->t_sleepstamp = 0;
+	thread->t_readystamp = 0;
+	thread->t_runstamp = 0;
+	thread->t_boost = THREAD_NPRIO;
+	thread->t_heldlocks = NULL;
+	thread->t_waitlock = NULL;
+	thread->t_waitprio = THREAD_NPRIO;
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -139,23 +217,49 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
+	thread_init(thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	return thread;
+}
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Get a thread, complete with stack, from the current cpu's cache of
+ * exited threads, and set it up as if new. Returns NULL if the cache
+ * is empty (or we run out of memory for the name).
+ *
+ * The cache is accessed only by its own cpu; turn interrupts off so
+ * we can't be preempted and moved elsewhere while using it.
+ */
+static
+struct thread *
+thread_recycle(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	newname = kstrdup(name);
+	if (newname == NULL) {
+		spl = splhigh();
+		threadlist_addhead(&curcpu->c_threadcache, thread);
+		splx(spl);
+		return NULL;
+	}
+	kfree(thread->t_name);
+	thread->t_name = newname;
+
+	thread_machdep_cleanup(&thread->t_machdep);
+	threadlistnode_cleanup(&thread->t_listnode);
+	thread_init(thread);
+	thread_checkstack_init(thread);
 
 	return thread;
 }
@@ -185,13 +289,25 @@ cpu_create(unsigned hardware_number)
 
 	c->c_curthread = NULL;
 	threadlist_init(&c->c_zombies);
-	c->c_hardclocks = 0;
+	threadlist_init(&c->c_threadcache);
 	c->c_spinlocks = 0;
+	c->c_tickless = false;
+	bzero(&c->c_rqdelay, sizeof(c->c_rqdelay));
+	bzero(&c->c_slice, sizeof(c->c_slice));
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
 	spinlock_init(&c->c_runqueue_lock);
 
+	timerwheel_init(&c->c_timers);
+	workqueue_init(&c->c_workq);
+
+	bzero(c->c_counters, sizeof(c->c_counters));
+
+	c->c_rcu_qs = 0;
+	c->c_rcu_snap = 0;
+	c->c_rcu_idle = false;
+
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
 	spinlock_init(&c->c_ipi_lock);
@@ -200,6 +316,8 @@ cpu_create(unsigned hardware_number)
 	if (result != 0) {
 		panic("cpu_create: array_add: %s\n", strerror(result));
 	}
+	/* Affinity masks have a bit per cpu. */
+	KASSERT(c->c_number < 32);
 
 	snprintf(namebuf, sizeof(namebuf), "<boot #%d>", c->c_number);
 	c->c_curthread = thread_create(namebuf);
@@ -234,6 +352,18 @@ cpu_create(unsigned hardware_number)
 	return c;
 }
 
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_get(unsigned num)
+{
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -273,7 +403,11 @@ thread_destroy(struct thread *thread)
  * Clean up zombies. (Zombies are threads that have exited but still
  * need to have thread_destroy called on them.)
  *
- * The list of zombies is per-cpu.
+ * Rather than destroying them outright, keep up to THREAD_CACHE_MAX
+ * of them, stacks and all, for thread_recycle; that way forking a
+ * thread doesn't have to go to the page allocator for a stack.
+ *
+ * The lists of zombies and cached threads are per-cpu.
  */
 static
 void
@@ -284,7 +418,15 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		KASSERT(z->t_proc == NULL);
+		if (z->t_stack != NULL &&
+		    curcpu->c_threadcache.tl_count < THREAD_CACHE_MAX) {
+			z->t_wchan_name = "CACHED";
+			threadlist_addtail(&curcpu->c_threadcache, z);
+		}
+		else {
+			thread_destroy(z);
+		}
 	}
 }
 
@@ -391,6 +533,12 @@ thread_bootstrap(void)
 	spinlock_init(&allwchans_lock);
 	wchanarray_init(&allwchans);
 
+	spinlock_init(&thread_move_lock);
+	thread_move_wchan = wchan_create("thread_move");
+	if (thread_move_wchan == NULL) {
+		panic("thread_bootstrap: Out of memory\n");
+	}
+
 	/* Done */
 }
 
@@ -442,6 +590,73 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Timestamp for scheduler statistics, in nanoseconds, or 0 if we
+ * aren't collecting them.
+ */
+static
+uint64_t
+schedstats_now(void)
+{
+	struct timespec ts;
+
+	if (!schedstats_enabled) {
+		return 0;
+	}
+	gettime(&ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Add an interval between timestamps START and END to a histogram.
+ */
+static
+void
+schedhist_add(struct schedhist *sh, uint64_t start, uint64_t end)
+{
+	uint64_t delay;
+	uint32_t usecs;
+	unsigned bucket;
+
+	if (start == 0 || end < start) {
+		/* Not stamped (or clock went backwards) */
+		return;
+	}
+	delay = end - start;
+	usecs = delay / 1000 > 0xffffffff ? 0xffffffff : delay / 1000;
+
+	bucket = 0;
+	while (usecs >= 2 && bucket < SCHEDHIST_BUCKETS - 1) {
+		usecs >>= 1;
+		bucket++;
+	}
+	sh->sh_count++;
+	sh->sh_total += delay;
+	sh->sh_buckets[bucket]++;
+}
+
+/*
+ * Put a thread on a cpu's run queue. The run queue is kept sorted by
+ * priority, and FIFO within each priority level, so the head is
+ * always the next thread to run. The run queue lock must be held.
+ */
+static
+void
+runqueue_add(struct cpu *c, struct thread *t)
+{
+	struct thread *onlist;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	THREADLIST_FORALL(onlist, c->c_runqueue) {
+		if (thread_effpriority(onlist) > thread_effpriority(t)) {
+			threadlist_insertbefore(&c->c_runqueue, t, onlist);
+			return;
+		}
+	}
+	threadlist_addtail(&c->c_runqueue, t);
+}
+
 /*
  * Make a thread runnable.
  *
@@ -466,7 +681,8 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 
 	/* Target thread is now ready to run; put it on the run queue. */
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	target->t_readystamp = schedstats_now();
+	runqueue_add(targetcpu, target);
 
 	if (targetcpu->c_isidle) {
 		/*
@@ -482,44 +698,42 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 }
 
 /*
- * Create a new thread based on an existing one.
- *
- * The new thread has name NAME, and starts executing in function
- * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
- *
- * The new thread is created in the process P. If P is null, the
- * process is inherited from the caller. It will start on the same CPU
- * as the caller, unless the scheduler intervenes first.
+ * Common code for thread_fork and thread_fork_bound. If BINDCPU is
+ * not NULL, the new thread starts there and stays there; otherwise it
+ * starts on the current cpu and is free to move.
  */
+static
 int
-thread_fork(const char *name,
-	    struct proc *proc,
-	    void (*entrypoint)(void *data1, unsigned long data2),
-	    void *data1, unsigned long data2)
+thread_fork_common(const char *name,
+		   struct proc *proc,
+		   struct cpu *bindcpu,
+		   void (*entrypoint)(void *data1, unsigned long data2),
+		   void *data1, unsigned long data2)
 {
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Reuse an exited thread and its stack if we have one handy */
+	newthread = thread_recycle(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
 
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 
 	/*
 	 * Now we clone various fields from the parent thread.
 	 */
 
-	/* Thread subsystem fields */
-	newthread->t_cpu = curthread->t_cpu;
-
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
 		proc = curthread->t_proc;
@@ -531,6 +745,26 @@ thread_fork(const char *name,
 		return result;
 	}
 
+	/*
+	 * Thread subsystem fields. The affinity mask comes from the
+	 * process; read it now we're attached, so we can't miss a
+	 * concurrent change (see proc_setaffinity).
+	 */
+	if (bindcpu != NULL) {
+		newthread->t_cpu = bindcpu;
+		newthread->t_cpumask = CPUMASK_BIT(bindcpu);
+	}
+	else {
+		spinlock_acquire(&proc->p_lock);
+		newthread->t_cpumask = proc->p_cpumask;
+		spinlock_release(&proc->p_lock);
+		newthread->t_cpu = curthread->t_cpu;
+		if (!CPUMASK_HAS(newthread->t_cpumask, newthread->t_cpu)) {
+			newthread->t_cpu =
+				thread_find_leastloaded(newthread->t_cpumask);
+		}
+	}
+
 	/*
 	 * Because new threads come out holding the cpu runqueue lock
 	 * (see notes at bottom of thread_switch), we need to account
@@ -541,12 +775,45 @@ thread_fork(const char *name,
 	/* Set up the switchframe so entrypoint() gets called */
 	switchframe_init(newthread, entrypoint, data1, data2);
 
-	/* Lock the current cpu's run queue and make the new thread runnable */
+	/* Lock the new thread's cpu's run queue and make it runnable */
 	thread_make_runnable(newthread, false);
 
 	return 0;
 }
 
+/*
+ * Create a new thread based on an existing one.
+ *
+ * The new thread has name NAME, and starts executing in function
+ * ENTRYPOINT. DATA1 and DATA2 are passed to ENTRYPOINT.
+ *
+ * The new thread is created in the process P. If P is null, the
+ * process is inherited from the caller. It will start on the same CPU
+ * as the caller, unless the scheduler intervenes first.
+ */
+int
+thread_fork(const char *name,
+	    struct proc *proc,
+	    void (*entrypoint)(void *data1, unsigned long data2),
+	    void *data1, unsigned long data2)
+{
+	return thread_fork_common(name, proc, NULL, entrypoint, data1, data2);
+}
+
+/*
+ * Like thread_fork, but the new thread runs on cpu C and is never
+ * migrated off it. For per-cpu kernel threads.
+ */
+int
+thread_fork_bound(struct cpu *c, const char *name,
+		  struct proc *proc,
+		  void (*entrypoint)(void *data1, unsigned long data2),
+		  void *data1, unsigned long data2)
+{
+	KASSERT(c != NULL);
+	return thread_fork_common(name, proc, c, entrypoint, data1, data2);
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -562,6 +829,7 @@ void
 thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *cur, *next;
+	uint64_t now;
 	int spl;
 
 	DEBUGASSERT(curcpu->c_curthread == curthread);
@@ -572,6 +840,9 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 
 	cur = curthread;
 
+	/* Nobody switches inside an RCU read-side section. */
+	rcu_quiescent();
+
 	/*
 	 * If we're idle, return without doing anything. This happens
 	 * when the timer interrupt interrupts the idle loop.
@@ -594,6 +865,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		return;
 	}
 
+	/* Account for the time the current thread ran. */
+	now = schedstats_now();
+	schedhist_add(&curcpu->c_slice, cur->t_runstamp, now);
+
 	/* Put the thread in the right place. */
 	switch (newstate) {
 	    case S_RUN:
@@ -603,6 +878,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_sleepstamp = counter_get(curcpu->c_self, CNT_HARDCLOCKS);
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -612,6 +888,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		 * on the list.
 		 */
 		threadlist_addtail(&wc->wc_threads, cur);
+		cur->t_wchan = wc;
 		spinlock_release(lk);
 		break;
 	    case S_ZOMBIE:
@@ -636,6 +913,10 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * Before idling, try to steal work from another cpu. Do this
+	 * with our own runqueue unlocked so we never hold two runqueue
+	 * locks at once.
 	 */
 
 	/* The current cpu is now idle. */
@@ -644,12 +925,26 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
 			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
+			next = thread_steal_idle();
+			if (next == NULL) {
+				hardclock_idle();
+				rcu_idle_enter();
+				cpu_idle();
+				rcu_idle_exit();
+			}
 			spinlock_acquire(&curcpu->c_runqueue_lock);
 		}
 	} while (next == NULL);
 	curcpu->c_isidle = false;
 
+	/* Account for the time the next thread waited to run. */
+	now = schedstats_now();
+	schedhist_add(&curcpu->c_rqdelay, next->t_readystamp, now);
+	next->t_runstamp = now;
+	if (next != cur) {
+		counter_inc(CNT_SWITCHES);
+	}
+
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
 	 * curthread and it may not be, depending on how curthread and
@@ -796,8 +1091,13 @@ thread_exit(void)
 	/*
 	 * Detach from our process. You might need to move this action
 	 * around, depending on how your wait/exit works.
+	 *
+	 * Exiting user threads detach themselves early (see
+	 * thread_syscalls.c), so we may already have done this.
 	 */
-	proc_remthread(cur);
+	if (cur->t_proc != NULL) {
+		proc_remthread(cur);
+	}
 
 	/* Make sure we *are* detached (move this only if you're sure!) */
 	KASSERT(cur->t_proc == NULL);
@@ -808,12 +1108,6 @@ thread_exit(void)
 	/* Interrupts off on this processor */
         splhigh();
 	thread_switch(S_ZOMBIE, NULL, NULL);
-
-	// if parent already dead then kill the process
-	if (curproc->parentDead) {
-		proc_destroy(curproc);
-	}
-
 	panic("braaaaaaaiiiiiiiiiiinssssss\n");
 }
 
@@ -831,139 +1125,415 @@ thread_yield(void)
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is a multi-level feedback queue. Each thread has a priority
+ * level (t_priority, 0 highest) and the run queue is kept sorted by
+ * level (see runqueue_add), so the highest-priority runnable thread
+ * always runs next, round-robin among equals.
+ *
+ *    - A thread that runs for its whole quantum is taken to be
+ *      CPU-bound and drops one level; the quantum doubles at each
+ *      level down. (thread_tick)
+ *
+ *    - A thread woken from a wait channel was waiting for I/O or
+ *      some other event and rises one level. (thread_wakeup)
+ *
+ *    - Periodically everything is boosted back to the top so that
+ *      CPU-bound threads can't be starved by a stream of
+ *      interactive ones. (schedule)
  */
 
+/*
+ * Charge the current thread for one hardclock and decide whether it
+ * should give up the processor: either its quantum has run out, or
+ * something of strictly higher priority is waiting.
+ */
+bool
+thread_tick(void)
+{
+	struct thread *cur, *next;
+	bool yield;
+
+	cur = curthread;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (curcpu->c_isidle) {
+		/* Nobody is really running; nothing to charge. */
+		spinlock_release(&curcpu->c_runqueue_lock);
+		return false;
+	}
+
+	cur->t_ticks++;
+	yield = cur->t_ticks >= THREAD_QUANTUM(cur->t_priority);
+	if (yield) {
+		cur->t_ticks = 0;
+		if (cur->t_priority < THREAD_PRIO_MIN) {
+			cur->t_priority++;
+		}
+	}
+
+	next = curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	if (next != NULL &&
+	    thread_effpriority(next) < thread_effpriority(cur)) {
+		yield = true;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	return yield;
+}
+
+/*
+ * Priority boost. This is called periodically from hardclock(); it
+ * moves everything on the current CPU, including the current thread,
+ * back to the top level. This keeps the run queue in the same order,
+ * so it stays sorted.
+ */
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct thread *t;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	THREADLIST_FORALL(t, curcpu->c_runqueue) {
+		t->t_priority = THREAD_PRIO_MAX;
+		t->t_ticks = 0;
+	}
+	if (!curcpu->c_isidle) {
+		curthread->t_priority = THREAD_PRIO_MAX;
+		curthread->t_ticks = 0;
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
+}
+
+unsigned
+thread_effpriority(const struct thread *t)
+{
+	return t->t_boost < t->t_priority ? t->t_boost : t->t_priority;
+}
+
+/*
+ * Change a thread's lent priority. If it's on a run queue its place
+ * there depends on it, so take it out and put it back. The thread
+ * could be stolen by another cpu until we have its run queue lock, so
+ * recheck which cpu it's on once we do. A thread that's just been
+ * stolen is ready but on no list for a moment; it'll be queued by the
+ * new boost when it is.
+ */
+void
+thread_setboost(struct thread *t, unsigned boost)
+{
+	struct cpu *c;
+
+	KASSERT(boost <= THREAD_NPRIO);
+
+	while (1) {
+		c = t->t_cpu;
+		spinlock_acquire(&c->c_runqueue_lock);
+		if (t->t_cpu == c) {
+			break;
+		}
+		spinlock_release(&c->c_runqueue_lock);
+	}
+
+	t->t_boost = boost;
+	if (t->t_state == S_READY && t->t_listnode.tln_prev != NULL) {
+		threadlist_remove(&c->c_runqueue, t);
+		runqueue_add(c, t);
+	}
+	spinlock_release(&c->c_runqueue_lock);
 }
 
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * This is done by work stealing: a cpu that has nothing to run pulls
+ * a thread over from the busiest other cpu (thread_switch calls
+ * thread_steal before going idle, and again every time an interrupt
+ * wakes it up), and thread_consider_migration, called periodically
+ * from hardclock(), pulls a thread from any cpu with noticeably more
+ * waiting than we have.
+ *
+ * Choosing a victim uses only the lock-free load hints; the only lock
+ * taken is the victim's run queue lock, and only when there's actually
+ * something to steal. We never hold two run queue locks at once.
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * which is fairly slow. We steal from the tail of the victim's run
+ * queue, which holds the lowest-priority (most CPU-bound) thread that
+ * would otherwise wait longest.
  */
-void
-thread_consider_migration(void)
+
+/*
+ * Load hint: the number of threads waiting on C's run queue. This is
+ * read without the run queue lock, so it may be stale by the time
+ * it's used; it is only good for choosing whom to steal from.
+ */
+static
+unsigned
+cpu_loadhint(struct cpu *c)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	return *(volatile unsigned *)&c->c_runqueue.tl_count;
+}
+
+/*
+ * Find the cpu other than this one with the most threads waiting, if
+ * it has more than MINLOAD of them.
+ */
+static
+struct cpu *
+thread_find_busiest(unsigned minload)
+{
+	struct cpu *c, *busiest;
+	unsigned i, numcpus, load;
 
-	my_count = total_count = 0;
+	busiest = NULL;
 	numcpus = cpuarray_num(&allcpus);
 	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
 		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
+			continue;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		load = cpu_loadhint(c);
+		if (load > minload) {
+			busiest = c;
+			minload = load;
+		}
+	}
+	return busiest;
+}
+
+/*
+ * Take a thread off VICTIM's run queue and give it to the current
+ * cpu. Returns NULL if there turned out to be nothing to take.
+ *
+ * Ordinarily, a cpu's curthread will not appear on its run queue.
+ * However, it can if it went to sleep, the processor became idle (so
+ * it remained curthread), it was reawakened, and the processor hasn't
+ * fully unidled yet. The victim is still running on that thread's
+ * stack, so migrating it would be disastrous; skip it. Also skip
+ * threads whose affinity doesn't allow the current cpu.
+ */
+static
+struct thread *
+thread_steal(struct cpu *victim)
+{
+	struct thread *t;
+
+	spinlock_acquire(&victim->c_runqueue_lock);
+	THREADLIST_FORALL_REV(t, victim->c_runqueue) {
+		if (t != victim->c_curthread &&
+		    CPUMASK_HAS(t->t_cpumask, curcpu)) {
+			break;
+		}
+	}
+	if (t != NULL) {
+		threadlist_remove(&victim->c_runqueue, t);
+		t->t_cpu = curcpu->c_self;
+		counter_inc(CNT_MIGRATIONS);
+		DEBUG(DB_THREADS,
+		      "Migrated thread %s: cpu %u -> %u",
+		      t->t_name, victim->c_number, curcpu->c_number);
 	}
+	spinlock_release(&victim->c_runqueue_lock);
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
+	return t;
+}
+
+/*
+ * Called by an idle cpu: steal from whoever has anything waiting.
+ */
+static
+struct thread *
+thread_steal_idle(void)
+{
+	struct cpu *victim;
+
+	victim = thread_find_busiest(0);
+	if (victim == NULL) {
+		return NULL;
+	}
+	return thread_steal(victim);
+}
+
+/*
+ * Periodic rebalancing, for cpus that are busy but have much less
+ * waiting than some other cpu. Pull one thread per call; this runs
+ * every MIGRATE_HARDCLOCKS so a large imbalance drains steadily.
+ */
+void
+thread_consider_migration(void)
+{
+	struct cpu *victim;
+	struct thread *t;
+
+	victim = thread_find_busiest(cpu_loadhint(curcpu->c_self) + 1);
+	if (victim == NULL) {
 		return;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	t = thread_steal(victim);
+	if (t != NULL) {
+		thread_make_runnable(t, false);
 	}
-	spinlock_release(&curcpu->c_runqueue_lock);
+}
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+/*
+ * Affinity enforcement for the current thread.
+ *
+ * A thread can't make itself runnable on another cpu while it's still
+ * running on its own stack. So to move, it goes to sleep, and a work
+ * item on this cpu's workqueue wakes it up; the worker only gets to
+ * run once we're off the cpu, and the wakeup then places us on a cpu
+ * our mask allows (see thread_wakeup_cpu).
+ */
+bool
+thread_affinity_ok(void)
+{
+	/* If we're preempted and moved meanwhile, we'll check again. */
+	return CPUMASK_HAS(curthread->t_cpumask, curcpu);
+}
+
+static
+void
+thread_move_wakeup(void *data)
+{
+	spinlock_acquire(&thread_move_lock);
+	wchan_wakethread(thread_move_wchan, &thread_move_lock, data);
+	spinlock_release(&thread_move_lock);
+}
+
+void
+thread_checkaffinity(void)
+{
+	struct work wk;
+
+	KASSERT(!curthread->t_in_interrupt);
+
+	if (thread_affinity_ok()) {
+		return;
+	}
+
+	/*
+	 * Holding the lock keeps us on this cpu, so the item goes on
+	 * our own worker's queue, and keeps the worker from trying to
+	 * wake us before we're asleep.
+	 */
+	work_init(&wk, thread_move_wakeup, curthread);
+	spinlock_acquire(&thread_move_lock);
+	workqueue_enqueue(&wk);
+	wchan_sleep(thread_move_wchan, &thread_move_lock);
+	spinlock_release(&thread_move_lock);
+}
+
+void
+thread_cpustats(void)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
-		if (c == curcpu->c_self) {
+		kprintf("cpu%u: %llu hardclocks, %llu avoided while idle; "
+			"%llu affine and %llu idle wakeups\n", c->c_number,
+			(unsigned long long)counter_get(c, CNT_HARDCLOCKS),
+			(unsigned long long)counter_get(c, CNT_TICKS_AVOIDED),
+			(unsigned long long)counter_get(c, CNT_WAKEUPS_AFFINE),
+			(unsigned long long)counter_get(c, CNT_WAKEUPS_IDLE));
+	}
+}
+
+/*
+ * Scheduler statistics report.
+ */
+
+/* Room for one cpu's worth of report. */
+#define SCHEDSTATS_CPUBYTES	640
+
+void
+thread_schedstats_start(void)
+{
+	schedstats_enabled = true;
+}
+
+/*
+ * Append one histogram to the report. Only nonempty buckets are
+ * shown, each labelled with its lower bound in microseconds.
+ */
+static
+size_t
+schedhist_print(char *buf, size_t len, size_t pos, const char *what,
+		const struct schedhist *sh)
+{
+	unsigned i;
+
+	pos += snprintf(buf + pos, len - pos, "  %-9s n=%u mean=%uus",
+			what, sh->sh_count, sh->sh_count == 0 ? 0 :
+			(unsigned)(sh->sh_total / sh->sh_count / 1000));
+	if (pos > len) {
+		pos = len;
+	}
+	for (i=0; i<SCHEDHIST_BUCKETS; i++) {
+		if (sh->sh_buckets[i] == 0) {
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
-
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+		pos += snprintf(buf + pos, len - pos, " [%u%s]%u",
+				i == 0 ? 0 : 1U << i,
+				i == SCHEDHIST_BUCKETS - 1 ? "+" : "",
+				sh->sh_buckets[i]);
+		if (pos > len) {
+			pos = len;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+	}
+	pos += snprintf(buf + pos, len - pos, "\n");
+	return pos > len ? len : pos;
+}
+
+char *
+thread_schedstats(size_t *lenret)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+	char *buf;
+	size_t len, pos;
+
+	numcpus = cpuarray_num(&allcpus);
+	len = SCHEDSTATS_CPUBYTES * numcpus;
+	buf = kmalloc(len);
+	if (buf == NULL) {
+		return NULL;
 	}
 
 	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * The counters are only ever updated by their own cpu; we
+	 * read them without locking, so the report is a snapshot
+	 * that may be very slightly inconsistent.
 	 */
-	if (!threadlist_isempty(&victims)) {
-		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+	pos = 0;
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		pos += snprintf(buf + pos, len - pos,
+				"cpu%u: %llu switches, %llu migrations, "
+				"%u threads queued\n", c->c_number,
+				(unsigned long long)
+				counter_get(c, CNT_SWITCHES),
+				(unsigned long long)
+				counter_get(c, CNT_MIGRATIONS),
+				cpu_loadhint(c));
+		if (pos > len) {
+			pos = len;
 		}
-		spinlock_release(&curcpu->c_runqueue_lock);
+		pos = schedhist_print(buf, len, pos, "runqueue", &c->c_rqdelay);
+		pos = schedhist_print(buf, len, pos, "slice", &c->c_slice);
+	}
+	if (pos == len) {
+		/* Truncated; make sure it's still terminated. */
+		pos--;
 	}
+	buf[pos] = '\0';
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+	*lenret = pos;
+	return buf;
 }
 
 ////////////////////////////////////////////////////////////
@@ -1057,6 +1627,139 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 	spinlock_acquire(lk);
 }
 
+/*
+ * Find an idle cpu among those in MASK, preferring the current one.
+ * This reads c_isidle without the run queue lock, so it's only a hint.
+ */
+static
+struct cpu *
+thread_find_idle(unsigned mask)
+{
+	struct cpu *c;
+	unsigned i, numcpus;
+
+	if (curcpu->c_isidle && CPUMASK_HAS(mask, curcpu)) {
+		return curcpu->c_self;
+	}
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (CPUMASK_HAS(mask, c) &&
+		    *(volatile bool *)&c->c_isidle) {
+			return c;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Find the cpu in MASK with the least waiting. MASK must include at
+ * least one cpu. Like the above, a hint.
+ */
+static
+struct cpu *
+thread_find_leastloaded(unsigned mask)
+{
+	struct cpu *c, *best;
+	unsigned i, numcpus, load, bestload;
+
+	best = NULL;
+	bestload = 0;
+	numcpus = cpuarray_num(&allcpus);
+	for (i=0; i<numcpus; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!CPUMASK_HAS(mask, c)) {
+			continue;
+		}
+		load = cpu_loadhint(c);
+		if (best == NULL || load < bestload) {
+			best = c;
+			bestload = load;
+		}
+	}
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Choose the cpu a waking thread should run on: its last cpu, for
+ * cache affinity, if that cpu is idle or the thread only slept
+ * briefly; otherwise an idle cpu if there is one. Only cpus in the
+ * thread's affinity mask are considered; if the last cpu isn't one
+ * of them, the thread goes to an idle one or failing that the least
+ * loaded one.
+ *
+ * The last cpu may still be running on TARGET's stack: it put TARGET
+ * on the wait channel, found nothing else to do, and is sitting in
+ * the idle loop with TARGET as curthread (see thread_switch). Then
+ * TARGET must stay put, even if its affinity says otherwise; it gets
+ * moved later (see thread_checkaffinity). That cpu holds its run
+ * queue lock from before TARGET went on the wait channel until it has
+ * switched off TARGET's stack, so checking c_curthread under that lock
+ * is sufficient.
+ */
+static
+struct cpu *
+thread_wakeup_cpu(struct thread *target)
+{
+	struct cpu *last, *other;
+	bool allowed, stuck;
+
+	last = target->t_cpu;
+	allowed = CPUMASK_HAS(target->t_cpumask, last);
+	if (allowed && (*(volatile bool *)&last->c_isidle ||
+			(unsigned)counter_get(last, CNT_HARDCLOCKS) -
+			target->t_sleepstamp <
+			WAKEUP_AFFINE_HARDCLOCKS)) {
+		counter_inc(CNT_WAKEUPS_AFFINE);
+		return last;
+	}
+
+	other = thread_find_idle(target->t_cpumask);
+	if (other == NULL && !allowed) {
+		other = thread_find_leastloaded(target->t_cpumask);
+	}
+	if (other == NULL || other == last) {
+		counter_inc(CNT_WAKEUPS_AFFINE);
+		return last;
+	}
+
+	spinlock_acquire(&last->c_runqueue_lock);
+	stuck = (last->c_curthread == target);
+	spinlock_release(&last->c_runqueue_lock);
+	if (stuck) {
+		counter_inc(CNT_WAKEUPS_AFFINE);
+		return last;
+	}
+
+	counter_inc(CNT_WAKEUPS_IDLE);
+	return other;
+}
+
+/*
+ * Make a thread taken off a wait channel runnable. It was waiting for
+ * I/O or some other event rather than computing, so it moves up a
+ * priority level and gets a fresh quantum.
+ */
+static
+void
+thread_wakeup(struct thread *target)
+{
+	struct cpu *c;
+
+	if (target->t_priority > THREAD_PRIO_MAX) {
+		target->t_priority--;
+	}
+	target->t_ticks = 0;
+
+	c = thread_wakeup_cpu(target);
+	if (c != target->t_cpu) {
+		counter_inc(CNT_MIGRATIONS);
+		target->t_cpu = c;
+	}
+	thread_make_runnable(target, false);
+}
+
 /*
  * Wake up one thread sleeping on a wait channel.
  */
@@ -1074,6 +1777,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 		/* Nobody was sleeping. */
 		return;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1083,7 +1787,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 * in thread_switch.
 	 */
 
-	thread_make_runnable(target, false);
+	thread_wakeup(target);
 }
 
 /*
@@ -1104,6 +1808,7 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
@@ -1113,12 +1818,32 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * make each thread runnable.
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
-		thread_make_runnable(target, false);
+		thread_wakeup(target);
 	}
 
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Wake up TARGET if it is sleeping on a wait channel. Returns true if
+ * it was. Threads are only put on or taken off WC's list with LK held,
+ * and t_wchan is kept up to date along with that, so it says whether
+ * TARGET is there without looking at the rest of the list.
+ */
+bool
+wchan_wakethread(struct wchan *wc, struct spinlock *lk, struct thread *target)
+{
+	KASSERT(spinlock_do_i_hold(lk));
+
+	if (target->t_wchan != wc) {
+		return false;
+	}
+	threadlist_remove(&wc->wc_threads, target);
+	target->t_wchan = NULL;
+	thread_wakeup(target);
+	return true;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -0,0 +1,393 @@
+/*
+ * Kernel timers.
+ *
+ * Each cpu has a timing wheel (in struct cpu) with TIMER_LEVELS
+ * levels of TIMER_SLOTS slots. A timer due less than TIMER_SLOTS
+ * ticks from now goes in level 0, in the slot for its exact expiry
+ * tick; one due within TIMER_SLOTS^2 ticks goes in level 1, in the
+ * slot for its expiry divided by TIMER_SLOTS; and so on. Each time
+ * level 0 wraps around, the next level 1 slot is emptied and its
+ * timers are redistributed ("cascaded") into level 0, and likewise
+ * up the hierarchy. Timers further out than the top level can reach
+ * are parked in the top level and cascaded until they fit.
+ *
+ * The wheel's lock is held while timer functions run. This is what
+ * lets timer_cancel promise that the function isn't running once it
+ * returns, which in turn lets callers keep timers on the stack.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <clock.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <timer.h>
+
+/* Longest timer we accept, so expiry comparisons can't wrap. */
+#define TIMER_MAXTICKS	0x7fffffffU
+
+/* Span of the whole wheel, in ticks. */
+#define TIMER_SPAN	(1U << (TIMER_SLOTBITS * TIMER_LEVELS))
+
+#define NSEC_PER_TICK	(1000000000U / HZ)
+#define MSEC_PER_SEC	1000U
+
+/*
+ * Wait channels for timer_sleep. Sleepers are spread over the buckets
+ * by thread, so sleepers on different cpus don't all go through one
+ * lock; each sleeper's timer wakes its own thread directly.
+ */
+#define TIMER_SLEEPBUCKETS	16
+
+struct timer_sleepbucket {
+	struct spinlock tsb_lock;
+	struct wchan *tsb_wchan;
+};
+static struct timer_sleepbucket timer_sleepbuckets[TIMER_SLEEPBUCKETS];
+
+////////////////////////////////////////////////////////////
+//
+// Wheel
+
+void
+timerwheel_init(struct timerwheel *tw)
+{
+	unsigned i, j;
+
+	spinlock_init(&tw->tw_lock);
+	tw->tw_now = 0;
+	tw->tw_count = 0;
+	for (i=0; i<TIMER_LEVELS; i++) {
+		for (j=0; j<TIMER_SLOTS; j++) {
+			tw->tw_slots[i][j] = NULL;
+		}
+	}
+}
+
+void
+timerwheel_cleanup(struct timerwheel *tw)
+{
+	KASSERT(tw->tw_count == 0);
+	spinlock_cleanup(&tw->tw_lock);
+}
+
+/*
+ * Put a timer in the right slot for its expiry time. Wheel must be
+ * locked.
+ */
+static
+void
+timerwheel_insert(struct timerwheel *tw, struct timer *tm)
+{
+	unsigned delta, when, level;
+	struct timer **slot;
+
+	delta = tm->tm_expires - tw->tw_now;
+	when = tm->tm_expires;
+	if (delta >= TIMER_SPAN) {
+		/* Park it as far out as we can; it'll get recascaded. */
+		when = tw->tw_now + TIMER_SPAN - 1;
+		delta = TIMER_SPAN - 1;
+	}
+
+	level = 0;
+	while (delta >= TIMER_SLOTS) {
+		delta >>= TIMER_SLOTBITS;
+		level++;
+	}
+	KASSERT(level < TIMER_LEVELS);
+
+	slot = &tw->tw_slots[level]
+		[(when >> (TIMER_SLOTBITS * level)) & (TIMER_SLOTS - 1)];
+	tm->tm_next = *slot;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = &tm->tm_next;
+	}
+	tm->tm_prevp = slot;
+	*slot = tm;
+}
+
+/*
+ * Take a timer out of its slot. Wheel must be locked.
+ */
+static
+void
+timerwheel_remove(struct timer *tm)
+{
+	*tm->tm_prevp = tm->tm_next;
+	if (tm->tm_next != NULL) {
+		tm->tm_next->tm_prevp = tm->tm_prevp;
+	}
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+}
+
+/*
+ * Empty slot INDEX of level LEVEL, redistributing its timers into
+ * the lower levels.
+ */
+static
+void
+timerwheel_cascade(struct timerwheel *tw, unsigned level, unsigned index)
+{
+	struct timer *tm;
+
+	while ((tm = tw->tw_slots[level][index]) != NULL) {
+		timerwheel_remove(tm);
+		timerwheel_insert(tw, tm);
+	}
+}
+
+/*
+ * Advance the current cpu's wheel by one tick and run the timers
+ * that come due. Called from hardclock.
+ */
+void
+timerwheel_tick(void)
+{
+	struct timerwheel *tw;
+	struct timer *tm;
+	unsigned level, index;
+
+	tw = &curcpu->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	tw->tw_now++;
+	if (tw->tw_count == 0) {
+		/* Nothing to cascade or run. */
+		spinlock_release(&tw->tw_lock);
+		return;
+	}
+
+	/* Cascade from each level that the lower one just wrapped into. */
+	for (level = 1; level < TIMER_LEVELS; level++) {
+		if ((tw->tw_now &
+		     ((1U << (TIMER_SLOTBITS * level)) - 1)) != 0) {
+			break;
+		}
+		index = (tw->tw_now >> (TIMER_SLOTBITS * level))
+			& (TIMER_SLOTS - 1);
+		timerwheel_cascade(tw, level, index);
+	}
+
+	index = tw->tw_now & (TIMER_SLOTS - 1);
+	while ((tm = tw->tw_slots[0][index]) != NULL) {
+		timerwheel_remove(tm);
+		KASSERT(tm->tm_expires == tw->tw_now);
+		tm->tm_pending = false;
+		tw->tw_count--;
+		tm->tm_func(tm->tm_data);
+	}
+	spinlock_release(&tw->tw_lock);
+}
+
+unsigned
+timerwheel_idleticks(struct timerwheel *tw, unsigned max)
+{
+	unsigned ticks, when;
+
+	KASSERT(max <= TIMER_SLOTS);
+
+	spinlock_acquire(&tw->tw_lock);
+	if (tw->tw_count == 0) {
+		spinlock_release(&tw->tw_lock);
+		return max;
+	}
+	for (ticks = 1; ticks < max; ticks++) {
+		when = tw->tw_now + ticks;
+		if ((when & (TIMER_SLOTS - 1)) == 0 ||
+		    tw->tw_slots[0][when & (TIMER_SLOTS - 1)] != NULL) {
+			break;
+		}
+	}
+	spinlock_release(&tw->tw_lock);
+	return ticks;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timers
+
+void
+timer_init(struct timer *tm, void (*func)(void *), void *data)
+{
+	tm->tm_next = NULL;
+	tm->tm_prevp = NULL;
+	tm->tm_wheel = NULL;
+	tm->tm_expires = 0;
+	tm->tm_pending = false;
+	tm->tm_func = func;
+	tm->tm_data = data;
+}
+
+void
+timer_add(struct timer *tm, unsigned ticks)
+{
+	struct timerwheel *tw;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > TIMER_MAXTICKS) {
+		ticks = TIMER_MAXTICKS;
+	}
+
+	/*
+	 * If we get preempted and moved between reading curcpu and
+	 * taking the lock, the timer goes on our old cpu's wheel.
+	 * That's harmless.
+	 */
+	tw = &curcpu->c_timers;
+
+	spinlock_acquire(&tw->tw_lock);
+	KASSERT(!tm->tm_pending);
+	tm->tm_wheel = tw;
+	tm->tm_expires = tw->tw_now + ticks;
+	tm->tm_pending = true;
+	timerwheel_insert(tw, tm);
+	tw->tw_count++;
+	spinlock_release(&tw->tw_lock);
+}
+
+bool
+timer_cancel(struct timer *tm)
+{
+	struct timerwheel *tw;
+	bool ret;
+
+	tw = tm->tm_wheel;
+	if (tw == NULL) {
+		/* Never added. */
+		return false;
+	}
+
+	/* Taking the lock also waits out a timer function in progress. */
+	spinlock_acquire(&tw->tw_lock);
+	ret = tm->tm_pending;
+	if (ret) {
+		timerwheel_remove(tm);
+		tm->tm_pending = false;
+		tw->tw_count--;
+	}
+	spinlock_release(&tw->tw_lock);
+
+	return ret;
+}
+
+/*
+ * Conversions. These round up, and add one more tick to cover the
+ * part of the current tick that has already gone by, so a timer
+ * never goes off early.
+ */
+unsigned
+timer_mstoticks(unsigned msecs)
+{
+	uint64_t ticks;
+
+	ticks = ((uint64_t)msecs * HZ + MSEC_PER_SEC - 1) / MSEC_PER_SEC;
+	ticks++;
+	return ticks > TIMER_MAXTICKS ? TIMER_MAXTICKS : ticks;
+}
+
+unsigned
+timer_tstoticks(const struct timespec *ts)
+{
+	uint64_t ticks;
+
+	KASSERT(ts->tv_sec >= 0);
+	KASSERT(ts->tv_nsec >= 0);
+
+	if (ts->tv_sec >= TIMER_MAXTICKS / HZ) {
+		return TIMER_MAXTICKS;
+	}
+	ticks = (uint64_t)ts->tv_sec * HZ;
+	ticks += (ts->tv_nsec + NSEC_PER_TICK - 1) / NSEC_PER_TICK;
+	ticks++;
+	return ticks > TIMER_MAXTICKS ? TIMER_MAXTICKS : ticks;
+}
+
+////////////////////////////////////////////////////////////
+//
+// Timed sleeps
+
+/*
+ * Timer function for timedwait: wake the thread if it's asleep.
+ */
+static
+void
+timedwait_expire(void *data)
+{
+	struct timedwait *td = data;
+
+	spinlock_acquire(td->td_lock);
+	td->td_expired = true;
+	wchan_wakethread(td->td_wchan, td->td_lock, td->td_thread);
+	spinlock_release(td->td_lock);
+}
+
+void
+timedwait_start(struct timedwait *td, struct wchan *wc,
+		struct spinlock *lk, unsigned ticks)
+{
+	/* The timer function takes LK; we mustn't hold it here. */
+	KASSERT(!spinlock_do_i_hold(lk));
+
+	td->td_wchan = wc;
+	td->td_lock = lk;
+	td->td_thread = curthread;
+	td->td_expired = false;
+	timer_init(&td->td_timer, timedwait_expire, td);
+	timer_add(&td->td_timer, ticks);
+}
+
+bool
+timedwait_finish(struct timedwait *td)
+{
+	KASSERT(!spinlock_do_i_hold(td->td_lock));
+
+	timer_cancel(&td->td_timer);
+	return td->td_expired;
+}
+
+void
+timer_bootstrap(void)
+{
+	struct timer_sleepbucket *tsb;
+	unsigned i;
+
+	for (i=0; i<TIMER_SLEEPBUCKETS; i++) {
+		tsb = &timer_sleepbuckets[i];
+		spinlock_init(&tsb->tsb_lock);
+		tsb->tsb_wchan = wchan_create("timer_sleep");
+		if (tsb->tsb_wchan == NULL) {
+			panic("Couldn't create timer_sleep wchan\n");
+		}
+	}
+}
+
+/*
+ * Sleep for TICKS hardclocks.
+ */
+void
+timer_sleep(unsigned ticks)
+{
+	struct timer_sleepbucket *tsb;
+	struct timedwait td;
+
+	/* Thread structures are at least this big, so use the bits above. */
+	tsb = &timer_sleepbuckets[((uintptr_t)curthread / 64) %
+				  TIMER_SLEEPBUCKETS];
+
+	timedwait_start(&td, tsb->tsb_wchan, &tsb->tsb_lock, ticks);
+	spinlock_acquire(&tsb->tsb_lock);
+	while (!td.td_expired) {
+		wchan_sleep(tsb->tsb_wchan, &tsb->tsb_lock);
+	}
+	spinlock_release(&tsb->tsb_lock);
+	timedwait_finish(&td);
+}
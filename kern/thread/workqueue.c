@@ -0,0 +1,214 @@
+/*
+ * Deferred work: per-cpu queues and worker threads.
+ *
+ * Whether an item is pending is kept in wk_pending, which is set and
+ * cleared atomically (with the spinlock test-and-set primitive) rather
+ * than under a lock. That lets workqueue_enqueue decide whether it has
+ * anything to do without knowing which queue, if any, the item is on.
+ * The bit is set from enqueue until the worker is about to call the
+ * item's function; an item on its delay timer is pending too.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <cpu.h>
+#include <thread.h>
+#include <current.h>
+#include <timer.h>
+#include <workqueue.h>
+
+void
+workqueue_init(struct workqueue *wq)
+{
+	spinlock_init(&wq->wq_lock);
+	wq->wq_head = NULL;
+	wq->wq_tailp = &wq->wq_head;
+	/* Too early for wchan_create; workqueue_bootstrap does it. */
+	wq->wq_wchan = NULL;
+	wq->wq_batches = 0;
+	wq->wq_items = 0;
+}
+
+/*
+ * Put a pending item on the end of WQ and make sure the worker knows.
+ * It only needs waking if the queue was empty; otherwise it already
+ * has work and will pick this up in the same or the next batch.
+ */
+static
+void
+workqueue_add(struct workqueue *wq, struct work *wk)
+{
+	bool wasempty;
+
+	spinlock_acquire(&wq->wq_lock);
+	wk->wk_queue = wq;
+	wk->wk_next = NULL;
+	wasempty = (wq->wq_head == NULL);
+	*wq->wq_tailp = wk;
+	wq->wq_tailp = &wk->wk_next;
+	if (wasempty && wq->wq_wchan != NULL) {
+		wchan_wakeone(wq->wq_wchan, &wq->wq_lock);
+	}
+	spinlock_release(&wq->wq_lock);
+}
+
+/*
+ * Timer function for delayed work: the delay is up, so queue it on
+ * this cpu (the one it was enqueued on).
+ */
+static
+void
+workqueue_timerexpire(void *data)
+{
+	workqueue_add(&curcpu->c_workq, data);
+}
+
+void
+work_init(struct work *wk, void (*func)(void *), void *data)
+{
+	wk->wk_next = NULL;
+	wk->wk_func = func;
+	wk->wk_data = data;
+	wk->wk_queue = NULL;
+	spinlock_data_set(&wk->wk_pending, 0);
+	timer_init(&wk->wk_timer, workqueue_timerexpire, wk);
+}
+
+bool
+workqueue_enqueue(struct work *wk)
+{
+	if (spinlock_data_testandset(&wk->wk_pending) != 0) {
+		return false;
+	}
+
+	/*
+	 * As with timer_add, if we're preempted and moved, the item
+	 * goes on our old cpu's queue. That's harmless.
+	 */
+	workqueue_add(&curcpu->c_workq, wk);
+	return true;
+}
+
+bool
+workqueue_enqueue_delayed(struct work *wk, unsigned ticks)
+{
+	if (ticks == 0) {
+		return workqueue_enqueue(wk);
+	}
+	if (spinlock_data_testandset(&wk->wk_pending) != 0) {
+		return false;
+	}
+	timer_add(&wk->wk_timer, ticks);
+	return true;
+}
+
+bool
+workqueue_cancel(struct work *wk)
+{
+	struct workqueue *wq;
+	struct work **wkp;
+	bool found;
+
+	/* Still waiting out its delay? */
+	if (timer_cancel(&wk->wk_timer)) {
+		spinlock_data_set(&wk->wk_pending, 0);
+		return true;
+	}
+
+	/* Still on a queue? */
+	wq = wk->wk_queue;
+	if (wq == NULL) {
+		return false;
+	}
+	found = false;
+	spinlock_acquire(&wq->wq_lock);
+	for (wkp = &wq->wq_head; *wkp != NULL; wkp = &(*wkp)->wk_next) {
+		if (*wkp == wk) {
+			*wkp = wk->wk_next;
+			if (wq->wq_tailp == &wk->wk_next) {
+				wq->wq_tailp = wkp;
+			}
+			found = true;
+			break;
+		}
+	}
+	spinlock_release(&wq->wq_lock);
+
+	if (found) {
+		spinlock_data_set(&wk->wk_pending, 0);
+	}
+	return found;
+}
+
+/*
+ * Worker thread: take everything on the queue and run it, and repeat.
+ * Items taken into a batch are off the queue but still pending until
+ * their turn comes, so enqueueing one again in the meantime does
+ * nothing; it's going to run anyway.
+ */
+static
+void
+workqueue_worker(void *data, unsigned long junk)
+{
+	struct workqueue *wq = data;
+	struct work *batch, *wk, *next;
+	unsigned n;
+
+	(void)junk;
+
+	while (1) {
+		spinlock_acquire(&wq->wq_lock);
+		while (wq->wq_head == NULL) {
+			wchan_sleep(wq->wq_wchan, &wq->wq_lock);
+		}
+		batch = wq->wq_head;
+		wq->wq_head = NULL;
+		wq->wq_tailp = &wq->wq_head;
+		spinlock_release(&wq->wq_lock);
+
+		n = 0;
+		for (wk = batch; wk != NULL; wk = next) {
+			/* Once it's not pending it can be requeued. */
+			next = wk->wk_next;
+			spinlock_data_set(&wk->wk_pending, 0);
+			wk->wk_func(wk->wk_data);
+			n++;
+		}
+
+		/* Only we update these; readers can live with a race. */
+		wq->wq_batches++;
+		wq->wq_items += n;
+	}
+}
+
+void
+workqueue_bootstrap(void)
+{
+	struct workqueue *wq;
+	struct wchan *wc;
+	struct cpu *c;
+	unsigned i;
+	int result;
+
+	for (i=0; i<cpu_count(); i++) {
+		c = cpu_get(i);
+		wq = &c->c_workq;
+
+		wc = wchan_create("workqueue");
+		if (wc == NULL) {
+			panic("workqueue_bootstrap: Out of memory\n");
+		}
+		spinlock_acquire(&wq->wq_lock);
+		wq->wq_wchan = wc;
+		spinlock_release(&wq->wq_lock);
+
+		result = thread_fork_bound(c, "workqueue", NULL,
+					   workqueue_worker, wq, 0);
+		if (result) {
+			panic("workqueue_bootstrap: thread_fork_bound: %s\n",
+			      strerror(result));
+		}
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * Implementation of the scheduler statistics device, "schedstat:".
+ * Reading it produces a text report of per-cpu scheduling counters
+ * and latency histograms, the same one the schedstat menu command
+ * prints; e.g. "cat schedstat:" from the shell. It can't be written.
+ */
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <uio.h>
+#include <thread.h>
+#include <vfs.h>
+#include <device.h>
+
+/* For open() */
+static
+int
+schedstatopen(struct device *dev, int openflags)
+{
+	(void)dev;
+	(void)openflags;
+
+	return 0;
+}
+
+/* For d_io() */
+static
+int
+schedstatio(struct device *dev, struct uio *uio)
+{
+	char *report;
+	size_t len;
+	int result;
+
+	(void)dev; // unused
+
+	if (uio->uio_rw == UIO_WRITE) {
+		return EINVAL;
+	}
+
+	/*
+	 * Generate a fresh report on each read and hand back the part
+	 * at the current offset, so reading sequentially gets the
+	 * whole thing and then EOF.
+	 */
+	report = thread_schedstats(&len);
+	if (report == NULL) {
+		return ENOMEM;
+	}
+	if (uio->uio_offset >= (off_t)len) {
+		kfree(report);
+		return 0;
+	}
+	result = uiomove(report + uio->uio_offset, len - uio->uio_offset, uio);
+	kfree(report);
+	return result;
+}
+
+/* For ioctl() */
+static
+int
+schedstatioctl(struct device *dev, int op, userptr_t data)
+{
+	/*
+	 * No ioctls.
+	 */
+
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static const struct device_ops schedstat_devops = {
+	.devop_eachopen = schedstatopen,
+	.devop_io = schedstatio,
+	.devop_ioctl = schedstatioctl,
+};
+
+/*
+ * Function to create and attach schedstat:
+ */
+void
+devschedstat_create(void)
+{
+	int result;
+	struct device *dev;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev==NULL) {
+		panic("Could not add schedstat device: out of memory\n");
+	}
+
+	dev->d_ops = &schedstat_devops;
+
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+
+	dev->d_data = NULL;
+
+	result = vfs_adddev("schedstat", dev, 0);
+	if (result) {
+		panic("Could not add schedstat device: %s\n",
+		      strerror(result));
+	}
+}
@@ -31,6 +31,7 @@
 #include <lib.h>
 #include <spinlock.h>
 #include <vm.h>
+#include <counter.h>
 
 /*
  * Kernel malloc.
@@ -691,6 +692,170 @@ dump_subpages(unsigned generation)
 	}
 }
 
+/*
+ * Allocation-site profile.
+ *
+ * Live blocks are grouped by label (the return address of the
+ * kmalloc call) into a fixed-size table. The table is static because
+ * we can't call kmalloc while walking the heap with kmalloc_spinlock
+ * held; sites that don't fit are lumped together. "New" blocks are
+ * the ones allocated in the current generation, that is, since the
+ * last kheap_nextgeneration (khgen in the menu).
+ *
+ * Whole-page allocations don't carry labels and aren't counted.
+ */
+
+#define KHPROF_MAXSITES 128
+
+struct khprof_site {
+	vaddr_t label;		/* allocation site */
+	unsigned count;		/* live blocks */
+	size_t bytes;		/* live bytes (whole blocks) */
+	unsigned newcount;	/* live blocks from current generation */
+	size_t newbytes;	/* live bytes from current generation */
+};
+
+static struct khprof_site khprof_sites[KHPROF_MAXSITES];
+static unsigned khprof_numsites;
+static struct khprof_site khprof_other;
+
+/*
+ * Find (or add) the table entry for LABEL.
+ */
+static
+struct khprof_site *
+profile_getsite(vaddr_t label)
+{
+	struct khprof_site *site;
+	unsigned i;
+
+	for (i=0; i<khprof_numsites; i++) {
+		if (khprof_sites[i].label == label) {
+			return &khprof_sites[i];
+		}
+	}
+	if (khprof_numsites == KHPROF_MAXSITES) {
+		return &khprof_other;
+	}
+
+	site = &khprof_sites[khprof_numsites++];
+	site->label = label;
+	site->count = 0;
+	site->bytes = 0;
+	site->newcount = 0;
+	site->newbytes = 0;
+	return site;
+}
+
+static
+void
+profile_subpage(struct pageref *pr)
+{
+	unsigned blocksize = sizes[PR_BLOCKTYPE(pr)];
+	unsigned numblocks = PAGE_SIZE / blocksize;
+	unsigned numfreewords = DIVROUNDUP(numblocks, 32);
+	uint32_t isfree[numfreewords], mask;
+	vaddr_t prpage;
+	struct freelist *fl;
+	struct malloclabel *ml;
+	struct khprof_site *site;
+	unsigned i;
+
+	for (i=0; i<numfreewords; i++) {
+		isfree[i] = 0;
+	}
+
+	prpage = PR_PAGEADDR(pr);
+	if (pr->freelist_offset != INVALID_OFFSET) {
+		fl = (struct freelist *)(prpage + pr->freelist_offset);
+		for (; fl != NULL; fl = fl->next) {
+			i = ((vaddr_t)fl - prpage) / blocksize;
+			mask = 1U << (i % 32);
+			isfree[i / 32] |= mask;
+		}
+	}
+
+	for (i=0; i<numblocks; i++) {
+		mask = 1U << (i % 32);
+		if (isfree[i / 32] & mask) {
+			continue;
+		}
+		ml = (struct malloclabel *)(prpage + i * blocksize);
+		site = profile_getsite(ml->label);
+		site->count++;
+		site->bytes += blocksize;
+		if (ml->generation == mallocgeneration) {
+			site->newcount++;
+			site->newbytes += blocksize;
+		}
+	}
+}
+
+static
+void
+profile_print(const struct khprof_site *site, const char *name)
+{
+	if (name != NULL) {
+		kprintf("%-10s", name);
+	}
+	else {
+		kprintf("%p", (void *)site->label);
+	}
+	kprintf(" %7u %9zu %8u %9zu\n", site->count, site->bytes,
+		site->newcount, site->newbytes);
+}
+
+static
+void
+profile_subpages(void)
+{
+	struct khprof_site tmp;
+	struct pageref *pr;
+	unsigned i, j;
+	unsigned totcount = 0, totnew = 0;
+	size_t totbytes = 0, totnewbytes = 0;
+
+	KASSERT(spinlock_do_i_hold(&kmalloc_spinlock));
+
+	khprof_numsites = 0;
+	khprof_other.label = 0;
+	khprof_other.count = khprof_other.newcount = 0;
+	khprof_other.bytes = khprof_other.newbytes = 0;
+
+	for (pr = allbase; pr != NULL; pr = pr->next_all) {
+		profile_subpage(pr);
+	}
+
+	/* Sort by live bytes, biggest first. (Insertion sort; n is small.) */
+	for (i=1; i<khprof_numsites; i++) {
+		tmp = khprof_sites[i];
+		for (j=i; j>0 && khprof_sites[j-1].bytes < tmp.bytes; j--) {
+			khprof_sites[j] = khprof_sites[j-1];
+		}
+		khprof_sites[j] = tmp;
+	}
+
+	kprintf("Live allocations by site "
+		"(+ = since start of generation %u):\n", mallocgeneration);
+	kprintf("site        blocks     bytes   +blocks    +bytes\n");
+	for (i=0; i<khprof_numsites; i++) {
+		profile_print(&khprof_sites[i], NULL);
+		totcount += khprof_sites[i].count;
+		totbytes += khprof_sites[i].bytes;
+		totnew += khprof_sites[i].newcount;
+		totnewbytes += khprof_sites[i].newbytes;
+	}
+	if (khprof_other.count > 0) {
+		profile_print(&khprof_other, "(other)");
+		totcount += khprof_other.count;
+		totbytes += khprof_other.bytes;
+		totnew += khprof_other.newcount;
+		totnewbytes += khprof_other.newbytes;
+	}
+	kprintf("%-10s %7u %9zu %8u %9zu\n", "total", totcount, totbytes,
+		totnew, totnewbytes);
+}
+
 #else
 
 #define LABEL_OVERHEAD 0
@@ -737,6 +902,19 @@ kheap_dumpall(void)
 #endif
 }
 
+void
+kheap_profile(void)
+{
+#ifdef LABELS
+	/* print the whole thing with interrupts off */
+	spinlock_acquire(&kmalloc_spinlock);
+	profile_subpages();
+	spinlock_release(&kmalloc_spinlock);
+#else
+	kprintf("Enable LABELS in kmalloc.c to use this functionality.\n");
+#endif
+}
+
 ////////////////////////////////////////
 
 /*
@@ -803,6 +981,12 @@ kheap_printstats(void)
 	struct pageref *pr;
 
 	/* print the whole thing with interrupts off */
+	kprintf("%llu kmallocs (%llu whole-page, %llu failed), %llu kfrees\n",
+		(unsigned long long)counter_sum(CNT_KMALLOC),
+		(unsigned long long)counter_sum(CNT_KMALLOC_PAGES),
+		(unsigned long long)counter_sum(CNT_KMALLOC_FAILED),
+		(unsigned long long)counter_sum(CNT_KFREE));
+
 	spinlock_acquire(&kmalloc_spinlock);
 
 	kprintf("Subpage allocator status:\n");
@@ -1164,6 +1348,7 @@ void *
 kmalloc(size_t sz)
 {
 	size_t checksz;
+	void *ptr;
 #ifdef LABELS
 	vaddr_t label;
 #endif
@@ -1176,15 +1361,20 @@ kmalloc(size_t sz)
 #endif /* __GNUC__ */
 #endif /* LABELS */
 
+	counter_inc(CNT_KMALLOC);
+
 	checksz = sz + GUARD_OVERHEAD + LABEL_OVERHEAD;
 	if (checksz >= LARGEST_SUBPAGE_SIZE) {
 		unsigned long npages;
 		vaddr_t address;
 
+		counter_inc(CNT_KMALLOC_PAGES);
+
 		/* Round up to a whole number of pages. */
 		npages = (sz + PAGE_SIZE - 1)/PAGE_SIZE;
 		address = alloc_kpages(npages);
 		if (address==0) {
+			counter_inc(CNT_KMALLOC_FAILED);
 			return NULL;
 		}
 		KASSERT(address % PAGE_SIZE == 0);
@@ -1193,10 +1383,14 @@ kmalloc(size_t sz)
 	}
 
 #ifdef LABELS
-	return subpage_kmalloc(sz, label);
+	ptr = subpage_kmalloc(sz, label);
 #else
-	return subpage_kmalloc(sz);
+	ptr = subpage_kmalloc(sz);
 #endif
+	if (ptr == NULL) {
+		counter_inc(CNT_KMALLOC_FAILED);
+	}
+	return ptr;
 }
 
 /*
@@ -1210,7 +1404,9 @@ kfree(void *ptr)
 	 */
 	if (ptr == NULL) {
 		return;
-	} else if (subpage_kfree(ptr)) {
+	}
+	counter_inc(CNT_KFREE);
+	if (subpage_kfree(ptr)) {
 		KASSERT((vaddr_t)ptr%PAGE_SIZE==0);
 		free_kpages((vaddr_t)ptr);
 	}
@@ -211,42 +211,25 @@ dowait(pid_t pid)
 
 #ifdef WNOHANG
 /*
- * dowaitpoll
- * like dowait, but uses WNOHANG. returns true if we got something.
+ * waitpoll
+ * collect any background jobs that have exited, without waiting for
+ * the rest. one waitpid per job that has exited, however many are
+ * still running.
  */
 static
-int
-dowaitpoll(pid_t pid)
+void
+waitpoll(void)
 {
 	struct exitinfo ei;
-	pid_t foundpid;
-	int status;
+	pid_t pid;
+	int status, i;
 
-	foundpid = waitpid(pid, &status, WNOHANG);
-	if (foundpid < 0) {
-		warn("pid %d", pid);
-	}
-	else if (foundpid != 0) {
+	while ((pid = waitpid(WAIT_ANY, &status, WNOHANG)) > 0) {
 		printf("pid %d: ", pid);
 		readstatus(status, &ei);
 		printstatus(&ei, 1);
-		return 1;
-	}
-	return 0;
-}
-
-/*
- * waitpoll
- * poll all background jobs for having exited.
- */
-static
-void
-waitpoll(void)
-{
-	int i;
-	for (i=0; i < MAXBG; i++) {
-		if (bgpids[i] != 0) {
-			if (dowaitpoll(bgpids[i])) {
+		for (i=0; i < MAXBG; i++) {
+			if (bgpids[i] == pid) {
 				bgpids[i] = 0;
 			}
 		}
@@ -421,11 +404,16 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
+	/*
+	 * The child only execs, so it doesn't need its own copy of our
+	 * memory; with vfork it runs in ours until the exec (or the
+	 * _exit if that fails), and we carry on after that.
+	 */
+	pid = vfork();
 	switch (pid) {
 		case -1:
 			/* error */
-			warn("fork");
+			warn("vfork");
 			exitinfo_exit(ei, 255);
 			return;
 		case 0:
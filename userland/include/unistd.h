@@ -147,7 +147,17 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
 ssize_t __getcwd(char *buf, size_t buflen);
+int __thread_create(void (*entry)(void *), void *arg, void *stacktop);
+int thread_join(int tid, int *status);
+__DEAD void thread_exit(int status);
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, unsigned *mask);
+int sched_getcpu(void);
+int futex_wait(volatile int *addr, int val, unsigned msecs);
+int futex_wake(volatile int *addr, int count);
+pid_t vfork(void);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
 
@@ -158,5 +168,23 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int thread_create(int (*func)(void *), void *arg,
+		  void *stack, size_t stacksize); /* calls __thread_create */
+
+/*
+ * Mutex for the threads of one process. Taking and releasing an
+ * uncontended one is done with atomic instructions alone; only a
+ * thread that has to wait, or one releasing a mutex that has waiters,
+ * calls futex_wait or futex_wake. Initialize with MUTEX_INITIALIZER or
+ * mutex_init.
+ */
+struct mutex {
+	volatile int m_state;	/* 0 free, 1 held, 2 held with waiters */
+};
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init(struct mutex *m);
+void mutex_lock(struct mutex *m);		/* may call futex_wait */
+void mutex_unlock(struct mutex *m);		/* may call futex_wake */
 
 #endif /* _UNISTD_H_ */
@@ -37,6 +37,9 @@
 /*
  * POSIX C function: exec a program on the search path. Tries
  * execv() repeatedly until one of the choices works.
+ *
+ * This is safe to call in the child of vfork(): it only uses its own
+ * stack frame, and writes no memory but errno.
  */
 int
 execvp(const char *prog, char *const *args)
@@ -0,0 +1,98 @@
+#include <unistd.h>
+
+/*
+ * Mutexes on top of futex_wait/futex_wake.
+ *
+ * m_state is 0 when the mutex is free, 1 when it is held and nobody is
+ * waiting, and 2 when it is held and somebody may be waiting. Locking
+ * a free mutex is one compare-and-swap from 0 to 1, and unlocking one
+ * that nobody waited for is one swap back to 0; neither enters the
+ * kernel. A thread that finds the mutex held sets it to 2 before going
+ * to sleep, so the holder knows to call futex_wake on its way out.
+ *
+ * A woken thread takes the mutex in state 2, not 1, since it can't
+ * tell whether anyone else is still waiting. At worst that costs one
+ * unneeded futex_wake.
+ */
+
+/*
+ * Atomic operations using LL/SC. If the SC fails, somebody else got
+ * in between, so go around again.
+ */
+
+static
+int
+mutex_cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	do {
+		y = 1;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"bne %0, %3, 1f;"	/*   if (x != old) don't store */
+			"move %1, %4;"		/*   y = new */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			"1:"
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "+&r" (y)
+			: "r" (p), "r" (old), "r" (new) : "memory");
+	} while (y == 0);
+	return x;
+}
+
+static
+int
+mutex_swap(volatile int *p, int new)
+{
+	int x, y;
+
+	do {
+		y = new;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "+r" (y) : "r" (p) : "memory");
+	} while (y == 0);
+	return x;
+}
+
+void
+mutex_init(struct mutex *m)
+{
+	m->m_state = 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+	int c;
+
+	c = mutex_cas(&m->m_state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+	if (c != 2) {
+		c = mutex_swap(&m->m_state, 2);
+	}
+	while (c != 0) {
+		/* EAGAIN just means it changed before we slept. */
+		futex_wait(&m->m_state, 2, 0);
+		c = mutex_swap(&m->m_state, 2);
+	}
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+	if (mutex_swap(&m->m_state, 0) == 2) {
+		futex_wake(&m->m_state, 1);
+	}
+}
@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*
+ * C function: start a new thread in this process running FUNC(ARG) on
+ * the stack STACK, which is STACKSIZE bytes. When FUNC returns, the
+ * thread exits with its return value as if by thread_exit(). Returns
+ * the new thread's id, for thread_join().
+ *
+ * The system call __thread_create() only knows how to start a thread
+ * at an entry point with one argument and a stack pointer. So we park
+ * FUNC and ARG at the top of the new stack and start the thread in a
+ * trampoline that picks them up from there.
+ *
+ * Note that malloc and stdio are not thread-safe; threads sharing
+ * them need to provide their own locking.
+ */
+
+struct thread_start {
+	int (*ts_func)(void *);
+	void *ts_arg;
+};
+
+/* Space the mips calling convention says a caller leaves for args. */
+#define ARGSPACE 16
+
+static
+void
+thread_trampoline(void *data)
+{
+	struct thread_start *ts = data;
+
+	thread_exit(ts->ts_func(ts->ts_arg));
+}
+
+int
+thread_create(int (*func)(void *), void *arg, void *stack, size_t stacksize)
+{
+	uintptr_t top;
+	struct thread_start *ts;
+
+	if (func == NULL || stack == NULL ||
+	    stacksize < sizeof(*ts) + ARGSPACE + 8) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Top of the stack, aligned down to 8 bytes. */
+	top = ((uintptr_t)stack + stacksize) & ~(uintptr_t)7;
+
+	top -= (sizeof(*ts) + 7) & ~(size_t)7;
+	ts = (struct thread_start *)top;
+	ts->ts_func = func;
+	ts->ts_arg = arg;
+
+	top -= ARGSPACE;
+	return __thread_create(thread_trampoline, ts, (void *)top);
+}
@@ -0,0 +1,175 @@
+/*
+ * affinitytest - test sched_setaffinity and sched_getaffinity.
+ *
+ * Checks that an empty mask is refused with EINVAL and changes
+ * nothing. Then pins itself to each cpu in turn, checks that
+ * sched_getaffinity reports just that cpu, and spins for a while
+ * checking with sched_getcpu that it never runs anywhere else. A
+ * child forked while pinned must inherit the mask and stay put too.
+ * Finally it sets a child's mask by pid and checks it reads back.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define MAXCPUS 32
+#define SPINS	200000
+
+/*
+ * Spin, checking that we stay on cpu CPU. Returns how many times we
+ * were found somewhere else.
+ */
+static
+unsigned
+spinon(int cpu)
+{
+	unsigned i, wrong;
+
+	wrong = 0;
+	for (i=0; i<SPINS; i++) {
+		if (sched_getcpu() != cpu) {
+			wrong++;
+		}
+	}
+	return wrong;
+}
+
+static
+void
+checkmask(pid_t pid, unsigned want)
+{
+	unsigned mask;
+
+	if (sched_getaffinity(pid, &mask) < 0) {
+		err(1, "sched_getaffinity(%d)", pid);
+	}
+	if (mask != want) {
+		errx(1, "pid %d: mask is 0x%x, expected 0x%x",
+		     pid, mask, want);
+	}
+}
+
+/*
+ * Pin ourselves to CPU and make sure that's where we run, both here
+ * and in a child forked from here.
+ */
+static
+void
+testcpu(int cpu)
+{
+	unsigned wrong;
+	pid_t pid;
+	int status;
+
+	if (sched_setaffinity(0, 1U << cpu) < 0) {
+		err(1, "sched_setaffinity to cpu %d", cpu);
+	}
+	checkmask(0, 1U << cpu);
+
+	wrong = spinon(cpu);
+	if (wrong > 0) {
+		errx(1, "pinned to cpu %d, but ran elsewhere %u times",
+		     cpu, wrong);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		checkmask(0, 1U << cpu);
+		_exit(spinon(cpu) > 0 ? 1 : 0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "child pinned to cpu %d ran elsewhere", cpu);
+	}
+}
+
+int
+main(void)
+{
+	unsigned orig, all;
+	volatile unsigned j;
+	int cpu, ncpus, first;
+	pid_t pid;
+	int status;
+
+	if (sched_getaffinity(0, &orig) < 0) {
+		err(1, "sched_getaffinity");
+	}
+
+	/* An empty mask allows nothing. */
+	if (sched_setaffinity(0, 0) != -1 || errno != EINVAL) {
+		errx(1, "sched_setaffinity with an empty mask didn't fail "
+		     "with EINVAL");
+	}
+	checkmask(0, orig);
+
+	/*
+	 * Find out which cpus there are: a mask of only cpus that don't
+	 * exist is empty too.
+	 */
+	all = 0;
+	ncpus = 0;
+	first = -1;
+	for (cpu=0; cpu<MAXCPUS; cpu++) {
+		if (sched_setaffinity(0, 1U << cpu) == 0) {
+			all |= 1U << cpu;
+			ncpus++;
+			if (first < 0) {
+				first = cpu;
+			}
+		}
+		else if (errno != EINVAL) {
+			err(1, "sched_setaffinity to cpu %d", cpu);
+		}
+	}
+	if (ncpus == 0) {
+		errx(1, "no cpu could be selected");
+	}
+	printf("affinitytest: %d cpus (mask 0x%x)\n", ncpus, all);
+
+	for (cpu=0; cpu<MAXCPUS; cpu++) {
+		if (all & (1U << cpu)) {
+			testcpu(cpu);
+			printf("affinitytest: cpu %d ok\n", cpu);
+		}
+	}
+
+	/* Set a child's mask from here. */
+	if (sched_setaffinity(0, all) < 0) {
+		err(1, "sched_setaffinity to all cpus");
+	}
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (j=0; j<SPINS; j++) {
+			/* spin */
+		}
+		_exit(0);
+	}
+	if (sched_setaffinity(pid, 1U << first) < 0) {
+		err(1, "sched_setaffinity for child %d", pid);
+	}
+	checkmask(pid, 1U << first);
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	/* Put things back the way they were. */
+	if (sched_setaffinity(0, orig) < 0) {
+		err(1, "sched_setaffinity back to 0x%x", orig);
+	}
+
+	printf("affinitytest: passed\n");
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * futextest - test futex_wait/futex_wake and the libc mutexes built
+ * on them.
+ *
+ * First checks the corner cases of futex_wait: it refuses to sleep if
+ * the word doesn't hold the expected value, and times out if nobody
+ * wakes it. Then some threads bang on a shared counter under a mutex;
+ * if the mutex doesn't exclude, increments get lost and the total
+ * comes out short. The time taken gives an idea of what a contended
+ * mutex costs; compare with usemtest, which goes through semfs.
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <errno.h>
+#include <err.h>
+
+#define NTHREADS  4
+#define NLOOPS    20000
+#define STACKSIZE 8192
+#define WAITMSECS 100
+
+static struct mutex countlock = MUTEX_INITIALIZER;
+static volatile int count;
+static volatile int word;
+
+static char stacks[NTHREADS][STACKSIZE];
+
+static
+int
+counter(void *junk)
+{
+	int i;
+
+	(void)junk;
+	for (i=0; i<NLOOPS; i++) {
+		mutex_lock(&countlock);
+		count++;
+		mutex_unlock(&countlock);
+	}
+	return 0;
+}
+
+/*
+ * Milliseconds from (S0, NS0) to (S1, NS1).
+ */
+static
+unsigned long
+msecs(time_t s0, unsigned long ns0, time_t s1, unsigned long ns1)
+{
+	return (unsigned long)(s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+}
+
+static
+void
+checkwait(void)
+{
+	time_t before, after;
+	unsigned long beforens, afterns;
+	int r;
+
+	word = 1;
+	r = futex_wait(&word, 0, 0);
+	if (r != -1 || errno != EAGAIN) {
+		errx(1, "futex_wait on a changed word: got %d (errno %d), "
+		     "expected EAGAIN", r, errno);
+	}
+
+	__time(&before, &beforens);
+	r = futex_wait(&word, 1, WAITMSECS);
+	__time(&after, &afterns);
+	if (r != -1 || errno != ETIMEDOUT) {
+		errx(1, "futex_wait with nobody to wake it: got %d "
+		     "(errno %d), expected ETIMEDOUT", r, errno);
+	}
+	if (msecs(before, beforens, after, afterns) < WAITMSECS) {
+		errx(1, "futex_wait timed out early");
+	}
+
+	r = futex_wake(&word, 1);
+	if (r != 0) {
+		errx(1, "futex_wake with no waiters woke %d", r);
+	}
+}
+
+int
+main(void)
+{
+	time_t before, after;
+	unsigned long beforens, afterns;
+	int i, status;
+	int tids[NTHREADS];
+
+	checkwait();
+	printf("futextest: futex_wait/futex_wake ok\n");
+
+	__time(&before, &beforens);
+	for (i=0; i<NTHREADS; i++) {
+		tids[i] = thread_create(counter, NULL, stacks[i], STACKSIZE);
+		if (tids[i] < 0) {
+			err(1, "thread_create");
+		}
+	}
+	for (i=0; i<NTHREADS; i++) {
+		if (thread_join(tids[i], &status) < 0) {
+			err(1, "thread_join");
+		}
+	}
+	__time(&after, &afterns);
+
+	if (count != NTHREADS * NLOOPS) {
+		errx(1, "count is %d, expected %d", count, NTHREADS * NLOOPS);
+	}
+	printf("futextest: %d locked increments in %lu ms\n",
+	       count, msecs(before, beforens, after, afterns));
+	printf("futextest: passed\n");
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * sysbench - syscall fast path microbenchmark
+ *
+ * Hammers read, write, and lseek and reports calls per second for
+ * each. The in-kernel I/O paths are supposed to be allocation-free;
+ * to check, run "khgen" from the kernel menu before and "khprof"
+ * after: the "+" columns should show nothing attributable to the
+ * syscall code no matter how many iterations ran.
+ *
+ * Usage: sysbench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <err.h>
+
+#define DEFAULT_LOOPS 20000
+#define TESTFILE "sysbench.tmp"
+
+static char buf[64];
+
+/*
+ * Current time in milliseconds.
+ */
+static
+unsigned long
+now_ms(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	if (__time(&secs, &nsecs) < 0) {
+		err(1, "__time");
+	}
+	return (unsigned long)secs * 1000 + nsecs / 1000000;
+}
+
+static
+void
+report(const char *name, unsigned loops, unsigned long start)
+{
+	unsigned long ms;
+
+	ms = now_ms() - start;
+	if (ms == 0) {
+		ms = 1;
+	}
+	printf("%-6s %8u calls in %6lu ms: %8lu calls/sec\n",
+	       name, loops, ms, (unsigned long)loops * 1000 / ms);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned loops, i;
+	unsigned long start;
+	int fd;
+
+	loops = DEFAULT_LOOPS;
+	if (argc == 2) {
+		loops = atoi(argv[1]);
+	}
+	else if (argc > 2) {
+		errx(1, "Usage: sysbench [iterations]");
+	}
+
+	fd = open(TESTFILE, O_RDWR|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s: open", TESTFILE);
+	}
+
+	/* One byte per call, so the loops measure syscall overhead. */
+	start = now_ms();
+	for (i=0; i<loops; i++) {
+		if (write(fd, &buf[i % sizeof(buf)], 1) != 1) {
+			err(1, "%s: write", TESTFILE);
+		}
+	}
+	report("write", loops, start);
+
+	start = now_ms();
+	for (i=0; i<loops; i++) {
+		if (lseek(fd, i, SEEK_SET) != (off_t)i) {
+			err(1, "%s: lseek", TESTFILE);
+		}
+	}
+	report("lseek", loops, start);
+
+	if (lseek(fd, 0, SEEK_SET) != 0) {
+		err(1, "%s: lseek", TESTFILE);
+	}
+	start = now_ms();
+	for (i=0; i<loops; i++) {
+		if (read(fd, buf, 1) != 1) {
+			err(1, "%s: read", TESTFILE);
+		}
+	}
+	report("read", loops, start);
+
+	close(fd);
+	remove(TESTFILE);
+	return 0;
+}
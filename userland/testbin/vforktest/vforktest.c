@@ -0,0 +1,107 @@
+/*
+ * vforktest - test vfork.
+ *
+ * A vforked child runs in its parent's memory until it execs or
+ * exits, and the parent doesn't get going again until then. So a
+ * store the child makes before _exit should be there when vfork
+ * returns in the parent, and a child that execs should look the same
+ * to waitpid as one made with fork. Also times a batch of
+ * vfork+exec+wait against fork+exec+wait.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+
+#define NRUNS 20
+
+static volatile int shared;
+
+/*
+ * Run /bin/false (or /bin/true) in a child made with vfork or fork,
+ * and check its exit status.
+ */
+static
+void
+runone(int usevfork, int wantfail)
+{
+	char *args[2];
+	pid_t pid;
+	int status;
+
+	args[0] = wantfail ? (char *)"/bin/false" : (char *)"/bin/true";
+	args[1] = NULL;
+
+	pid = usevfork ? vfork() : fork();
+	if (pid < 0) {
+		err(1, usevfork ? "vfork" : "fork");
+	}
+	if (pid == 0) {
+		execv(args[0], args);
+		_exit(255);
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != wantfail) {
+		errx(1, "%s: status %d", args[0], status);
+	}
+}
+
+/*
+ * Milliseconds to run NRUNS children.
+ */
+static
+unsigned long
+timeruns(int usevfork)
+{
+	time_t s0, s1;
+	unsigned long ns0, ns1;
+	unsigned i;
+
+	__time(&s0, &ns0);
+	for (i=0; i<NRUNS; i++) {
+		runone(usevfork, 0);
+	}
+	__time(&s1, &ns1);
+	return (unsigned long)(s1 - s0) * 1000 + ns1 / 1000000 - ns0 / 1000000;
+}
+
+int
+main(void)
+{
+	pid_t pid;
+	int status;
+
+	/* The child's store shows up in the parent, before it resumes. */
+	shared = 0;
+	pid = vfork();
+	if (pid < 0) {
+		err(1, "vfork");
+	}
+	if (pid == 0) {
+		shared = 1;
+		_exit(3);
+	}
+	if (shared != 1) {
+		errx(1, "parent resumed without seeing the child's store");
+	}
+	if (waitpid(pid, &status, 0) != pid) {
+		err(1, "waitpid");
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 3) {
+		errx(1, "vforked child: status %d, expected exit 3", status);
+	}
+
+	/* Exec'ing children. */
+	runone(1, 0);
+	runone(1, 1);
+
+	printf("vforktest: %d runs: fork %lu ms, vfork %lu ms\n", NRUNS,
+	       timeruns(0), timeruns(1));
+	printf("vforktest: passed\n");
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * waittest - test waitpid with WAIT_ANY and WNOHANG.
+ *
+ * Forks a batch of children that each exit with their own code, and
+ * checks that WNOHANG doesn't block while they're still running, that
+ * WAIT_ANY hands each one back exactly once with the right status,
+ * and that once they're all reaped there is nothing left to wait for.
+ * Then does the same for a larger batch reaped by pid in reverse
+ * order, to check that waiting for one child doesn't lose the others.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define NCHILDREN 32
+
+static pid_t pids[NCHILDREN];
+
+/*
+ * Fork N children; child I spins for a bit and exits with I.
+ */
+static
+void
+spawn(unsigned n)
+{
+	volatile unsigned j;
+	unsigned i;
+
+	for (i=0; i<n; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			for (j=0; j<100000; j++) {
+				/* spin */
+			}
+			_exit(i);
+		}
+	}
+}
+
+static
+unsigned
+findchild(pid_t pid)
+{
+	unsigned i;
+
+	for (i=0; i<NCHILDREN; i++) {
+		if (pids[i] == pid) {
+			return i;
+		}
+	}
+	errx(1, "waitpid returned pid %d, which isn't one of ours", pid);
+}
+
+static
+void
+checkstatus(pid_t pid, int status, unsigned want)
+{
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != (int)want) {
+		errx(1, "pid %d: status %d, expected exit %u",
+		     pid, status, want);
+	}
+}
+
+static
+void
+checknone(void)
+{
+	int status;
+
+	if (waitpid(WAIT_ANY, &status, 0) != -1 || errno != ECHILD) {
+		errx(1, "waitpid with no children left didn't fail "
+		     "with ECHILD");
+	}
+	if (waitpid(WAIT_ANY, &status, WNOHANG) != -1 || errno != ECHILD) {
+		errx(1, "WNOHANG waitpid with no children left didn't "
+		     "fail with ECHILD");
+	}
+}
+
+int
+main(void)
+{
+	unsigned seen[NCHILDREN];
+	unsigned i, polls;
+	pid_t pid;
+	int status;
+
+	checknone();
+
+	/* Any child, polling first. */
+	spawn(NCHILDREN);
+	for (i=0; i<NCHILDREN; i++) {
+		seen[i] = 0;
+	}
+	polls = 0;
+	for (i=0; i<NCHILDREN; i++) {
+		pid = waitpid(WAIT_ANY, &status, WNOHANG);
+		if (pid < 0) {
+			err(1, "waitpid WNOHANG");
+		}
+		if (pid == 0) {
+			polls++;
+			pid = waitpid(WAIT_ANY, &status, 0);
+			if (pid < 0) {
+				err(1, "waitpid WAIT_ANY");
+			}
+		}
+		checkstatus(pid, status, findchild(pid));
+		if (seen[findchild(pid)]++ != 0) {
+			errx(1, "pid %d reaped twice", pid);
+		}
+	}
+	checknone();
+	printf("waittest: reaped %u children, %u WNOHANG polls found "
+	       "nothing\n", NCHILDREN, polls);
+
+	/* By pid, backwards. */
+	spawn(NCHILDREN);
+	for (i=NCHILDREN; i-- > 0; ) {
+		pid = waitpid(pids[i], &status, 0);
+		if (pid != pids[i]) {
+			err(1, "waitpid %d", pids[i]);
+		}
+		checkstatus(pid, status, i);
+		if (waitpid(pids[i], &status, WNOHANG) != -1) {
+			errx(1, "pid %d could be waited for twice", pids[i]);
+		}
+	}
+	checknone();
+
+	printf("waittest: passed\n");
+	return 0;
+}